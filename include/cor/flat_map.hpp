@@ -0,0 +1,189 @@
+#ifndef _COR_FLAT_MAP_HPP_
+#define _COR_FLAT_MAP_HPP_
+
+#include <cor/util.hpp>
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include <stdint.h>
+#include <string.h>
+
+namespace cor
+{
+
+/// fast non-cryptographic hash of the byte range, words are mixed by
+/// multiplication
+static inline uint64_t hash_bytes(void const *src, size_t len)
+{
+    static const uint64_t m = 0x9e3779b97f4a7c15ULL;
+    auto p = static_cast<unsigned char const*>(src);
+    uint64_t h = len * m;
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        h = (h ^ w) * m;
+        h ^= h >> 29;
+    }
+    if (len) {
+        // byte loop is faster than memcpy() of the variable length
+        uint64_t w = 0;
+        for (size_t i = 0; i < len; ++i)
+            w |= uint64_t(p[i]) << (i * 8);
+        h = (h ^ w) * m;
+    }
+    h ^= h >> 32;
+    h *= m;
+    return h ^ (h >> 29);
+}
+
+/// hash of strings and string references, the same for equal
+/// strings of both types, so maps can be searched by StringRef
+struct StringRefHash
+{
+    size_t operator ()(StringRef const &s) const
+    {
+        return hash_bytes(s.data(), s.size());
+    }
+};
+
+struct StringRefEqual
+{
+    bool operator ()(StringRef const &a, StringRef const &b) const
+    {
+        return a == b;
+    }
+};
+
+/// hash of integer keys: Fibonacci hashing, the map uses high bits
+struct IntegerHash
+{
+    size_t operator ()(uint64_t v) const
+    {
+        return (v + 1) * 0x9e3779b97f4a7c15ULL;
+    }
+};
+
+/**
+ * Open addressing hash map w/o removal. Items are stored in the dense
+ * vector in the insertion order, the index is a power of 2 sized
+ * table of item numbers with parts of their hashes, so the probing
+ * compares keys only if hashes are likely equal.
+ *
+ * find() accepts any key type accepted by HashT and EqualT (e.g.
+ * StringRef for std::string keys) and never inserts anything. Item
+ * pointers are invalidated by insertion.
+ */
+template <typename KeyT, typename ValueT, typename HashT = std::hash<KeyT>,
+          typename EqualT = std::equal_to<KeyT> >
+class FlatMap
+{
+public:
+    typedef std::pair<KeyT, ValueT> value_type;
+    typedef typename std::vector<value_type>::const_iterator const_iterator;
+
+    FlatMap() : mask_(0) {}
+
+    size_t size() const { return items_.size(); }
+    bool empty() const { return items_.empty(); }
+
+    const_iterator begin() const { return items_.begin(); }
+    const_iterator end() const { return items_.end(); }
+
+    void reserve(size_t count)
+    {
+        items_.reserve(count);
+        if (count * 2 > index_.size())
+            rehash(count * 2);
+    }
+
+    /// @return value or nullptr if there is no such key
+    template <typename K>
+    ValueT *find(K const &key)
+    {
+        auto pos = lookup(key, hash_(key));
+        return index_.empty() || !index_[pos].item ? nullptr
+            : &items_[index_[pos].item - 1].second;
+    }
+
+    template <typename K>
+    ValueT const *find(K const &key) const
+    {
+        return const_cast<FlatMap*>(this)->find(key);
+    }
+
+    /// insert the value if there is no such key
+    /// @return value for the key and true if it is inserted
+    std::pair<ValueT*, bool> insert(KeyT const &key, ValueT const &value)
+    {
+        if ((items_.size() + 1) * 2 > index_.size())
+            rehash(std::max<size_t>(16, index_.size() * 2));
+        auto h = hash_(key);
+        auto pos = lookup(key, h);
+        auto &slot = index_[pos];
+        if (slot.item)
+            return std::make_pair(&items_[slot.item - 1].second, false);
+        items_.push_back(value_type(key, value));
+        slot = Slot{uint32_t(items_.size()), tag(h)};
+        return std::make_pair(&items_.back().second, true);
+    }
+
+private:
+    struct Slot
+    {
+        // item number + 1, 0 for the empty slot
+        uint32_t item;
+        uint32_t tag;
+    };
+
+    static uint32_t tag(size_t h) { return uint32_t(uint64_t(h) >> 32); }
+
+    size_t start(size_t h) const
+    {
+        // hashes can differ only in high bits
+        return (h ^ (uint64_t(h) >> 32)) & mask_;
+    }
+
+    /// @return position of the slot with the key or of the empty slot
+    template <typename K>
+    size_t lookup(K const &key, size_t h) const
+    {
+        if (index_.empty())
+            return 0;
+        auto t = tag(h);
+        for (auto pos = start(h); ; pos = (pos + 1) & mask_) {
+            auto const &slot = index_[pos];
+            if (!slot.item)
+                return pos;
+            if (slot.tag == t && equal_(items_[slot.item - 1].first, key))
+                return pos;
+        }
+    }
+
+    void rehash(size_t size)
+    {
+        size_t n = 16;
+        while (n < size)
+            n *= 2;
+        index_.assign(n, Slot{0, 0});
+        mask_ = n - 1;
+        for (size_t i = 0; i < items_.size(); ++i) {
+            auto h = hash_(items_[i].first);
+            auto pos = start(h);
+            while (index_[pos].item)
+                pos = (pos + 1) & mask_;
+            index_[pos] = Slot{uint32_t(i + 1), tag(h)};
+        }
+    }
+
+    std::vector<value_type> items_;
+    std::vector<Slot> index_;
+    size_t mask_;
+    HashT hash_;
+    EqualT equal_;
+};
+
+}
+
+#endif // _COR_FLAT_MAP_HPP_
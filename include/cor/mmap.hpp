@@ -0,0 +1,72 @@
+#ifndef _COR_MMAP_HPP_
+#define _COR_MMAP_HPP_
+
+#include <cor/util.hpp>
+
+#include <string>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+
+namespace cor
+{
+
+/// read-only mapping of the whole file into memory
+class MappedFile
+{
+public:
+    /// @param advice is passed to madvise(), sequential access by default
+    MappedFile(std::string const &path, int advice = MADV_SEQUENTIAL)
+        : data_(nullptr), size_(0)
+    {
+        FdHandle fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+        if (!fd.is_valid())
+            throw CError(errno, "Can't open " + path);
+
+        struct stat info;
+        if (::fstat(fd.value(), &info) < 0)
+            throw CError(errno, "Can't stat " + path);
+
+        // empty file can't be mapped
+        if (!info.st_size)
+            return;
+
+        auto p = ::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE,
+                        fd.value(), 0);
+        if (p == MAP_FAILED)
+            throw CError(errno, "Can't map " + path);
+
+        data_ = static_cast<char const*>(p);
+        size_ = info.st_size;
+        ::madvise(p, size_, advice);
+    }
+
+    MappedFile(MappedFile &&from)
+        : data_(from.data_), size_(from.size_)
+    {
+        from.data_ = nullptr;
+        from.size_ = 0;
+    }
+
+    ~MappedFile()
+    {
+        if (data_)
+            ::munmap(const_cast<char*>(data_), size_);
+    }
+
+    char const *data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    MappedFile(MappedFile const &);
+    MappedFile & operator =(MappedFile const &);
+
+    char const *data_;
+    size_t size_;
+};
+
+} // cor
+
+#endif // _COR_MMAP_HPP_
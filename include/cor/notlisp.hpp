@@ -33,9 +33,15 @@
 #include <algorithm>
 #include <stack>
 #include <utility>
+#include <vector>
+#include <atomic>
+#include <typeinfo>
+#include <stdint.h>
 
 #include <cor/error.hpp>
 #include <cor/sexp.hpp>
+#include <cor/flat_map.hpp>
+#include <cor/pool.hpp>
 
 namespace cor
 {
@@ -52,31 +58,220 @@ public:
 };
 
 class Expr;
-typedef std::shared_ptr<Expr> expr_ptr;
-typedef std::list<expr_ptr> expr_list_type;
+class Value;
 
-template <typename... Args>
-expr_ptr mk_expr(Args&& ...args)
+void add_ref(Expr const *);
+void release(Expr const *);
+
+/**
+ * Intrusive reference counting handle of Expr objects. The counter is
+ * a member of Expr, so copying the handle does not touch the separate
+ * control block, and the counting is not atomic for expressions
+ * created in the LocalRefs scope.
+ *
+ * It mimics std::shared_ptr interface, dynamic_pointer_cast() and
+ * static_pointer_cast() are overloaded for it in this namespace, so
+ * they are found by unqualified calls. Code written for
+ * std::shared_ptr calling std::dynamic_pointer_cast() should call
+ * them unqualified with
+ *
+ *     using cor::notlisp::dynamic_pointer_cast;
+ *
+ * it still works for std::shared_ptr then. Expressions are stored in
+ * std::shared_ptr by to_shared_ptr().
+ */
+template <typename T>
+class ExprHandle
+{
+public:
+    typedef T element_type;
+
+    ExprHandle() : p_(nullptr) {}
+    ExprHandle(std::nullptr_t) : p_(nullptr) {}
+    explicit ExprHandle(T *p) : p_(p) { if (p_) add_ref(p_); }
+    ExprHandle(ExprHandle const &from) : p_(from.p_) { if (p_) add_ref(p_); }
+    ExprHandle(ExprHandle &&from) : p_(from.p_) { from.p_ = nullptr; }
+
+    template <typename U>
+    ExprHandle(ExprHandle<U> const &from) : p_(from.get())
+    {
+        if (p_)
+            add_ref(p_);
+    }
+
+    template <typename U>
+    ExprHandle(ExprHandle<U> &&from) : p_(from.release_ownership()) {}
+
+    ~ExprHandle() { if (p_) release(p_); }
+
+    ExprHandle & operator =(ExprHandle from)
+    {
+        swap(from);
+        return *this;
+    }
+
+    void swap(ExprHandle &other) { std::swap(p_, other.p_); }
+    void reset() { ExprHandle().swap(*this); }
+
+    T *get() const { return p_; }
+    T &operator *() const { return *p_; }
+    T *operator ->() const { return p_; }
+    explicit operator bool() const { return p_ != nullptr; }
+
+    long use_count() const;
+
+    /// used by the move constructor of the related handle
+    T *release_ownership()
+    {
+        auto p = p_;
+        p_ = nullptr;
+        return p;
+    }
+
+private:
+    T *p_;
+};
+
+template <typename T, typename U>
+bool operator ==(ExprHandle<T> const &a, ExprHandle<U> const &b)
+{
+    return a.get() == b.get();
+}
+
+template <typename T, typename U>
+bool operator !=(ExprHandle<T> const &a, ExprHandle<U> const &b)
+{
+    return a.get() != b.get();
+}
+
+template <typename T>
+bool operator ==(ExprHandle<T> const &a, std::nullptr_t)
+{
+    return !a;
+}
+
+template <typename T>
+bool operator !=(ExprHandle<T> const &a, std::nullptr_t)
+{
+    return !!a;
+}
+
+// unqualified casts work for both std::shared_ptr and ExprHandle
+using std::dynamic_pointer_cast;
+using std::static_pointer_cast;
+
+template <typename T, typename U>
+ExprHandle<T> dynamic_pointer_cast(ExprHandle<U> const &p)
 {
-    return std::make_shared<Expr>(std::forward<Args>(args)...);
+    return ExprHandle<T>(dynamic_cast<T*>(p.get()));
 }
 
+template <typename T, typename U>
+ExprHandle<T> static_pointer_cast(ExprHandle<U> const &p)
+{
+    return ExprHandle<T>(static_cast<T*>(p.get()));
+}
+
+/// shared pointer holding the reference to the expression, for the
+/// code storing expressions as std::shared_ptr
+template <typename T>
+std::shared_ptr<T> to_shared_ptr(ExprHandle<T> const &p)
+{
+    if (!p)
+        return std::shared_ptr<T>();
+    return std::shared_ptr<T>(p.get(), [p](T *) {});
+}
+
+typedef ExprHandle<Expr> expr_ptr;
+/// list nodes are allocated from the pool, see cor::pool_allocate()
+typedef std::list<expr_ptr, PoolAllocator<expr_ptr> > expr_list_type;
+
+template <typename T, typename... Args>
+ExprHandle<T> mk_expr(Args&& ...args)
+{
+    return ExprHandle<T>(new T(std::forward<Args>(args)...));
+}
+
+/**
+ * Expressions created by the thread inside this scope use non-atomic
+ * reference counting, so they should not be shared with other threads.
+ * It is intended for the single-threaded interpreter session:
+ *
+ *     notlisp::LocalRefs local;
+ *     notlisp::Interpreter interpreter(env);
+ *     sexp::parse(msg, interpreter);
+ *
+ * Scopes can be nested
+ */
+class LocalRefs
+{
+public:
+    LocalRefs();
+    ~LocalRefs();
+private:
+    LocalRefs(LocalRefs const &);
+    LocalRefs & operator =(LocalRefs const &);
+
+    bool is_outer_local_;
+};
+
+/// expressions created now use non-atomic reference counting
+bool is_local_refs();
+
 class Env;
 typedef std::shared_ptr<Env> env_ptr;
 typedef std::function<expr_ptr (env_ptr, expr_list_type&)> lambda_type;
 
+/// id of the symbol name interned into the global symbol table
+typedef uint32_t symbol_id;
+static const symbol_id no_symbol = symbol_id(-1);
+
+/// get id of the name, interning it if it is not interned yet. Names
+/// are never removed from the table, so ids are small stable integers
+/// for the process lifetime. Thread-safe
+symbol_id intern(StringRef const &name);
+
+/// id of the interned name or no_symbol, the name is not interned, so
+/// arbitrary input atoms do not grow the table. Lookup does not lock,
+/// only interning does, so it is cheap for concurrent interpreters
+symbol_id find_symbol(StringRef const &name);
+
+std::string const &symbol_name(symbol_id id);
+
+/// environment binds symbols to values. Values are stored in the flat
+/// hash map by symbol ids, so lookup does not hash symbol names and
+/// missing symbols are not inserted
 class Env
 {
 public:
-    typedef std::unordered_map<std::string, expr_ptr> dict_type;
-    typedef typename dict_type::value_type item_type;
+    typedef std::pair<std::string, expr_ptr> item_type;
 
     Env() {}
-    Env(std::initializer_list<item_type> syms)
-        : dict(syms)
-    {}
+    /// the first binding of the name is used
+    Env(std::initializer_list<item_type> syms);
+
+    void set(symbol_id id, expr_ptr value);
+    void set(StringRef const &name, expr_ptr value)
+    {
+        set(intern(name), std::move(value));
+    }
+
+    /// value bound to the symbol or nullptr
+    expr_ptr get(symbol_id id) const
+    {
+        auto p = slots_.find(id);
+        return p ? *p : expr_ptr();
+    }
+
+    expr_ptr get(StringRef const &name) const
+    {
+        return get(find_symbol(name));
+    }
+
+    size_t size() const { return slots_.size(); }
 
-    dict_type dict;
+private:
+    FlatMap<symbol_id, expr_ptr, IntegerHash> slots_;
 };
 
 static inline env_ptr mk_env(std::initializer_list<Env::item_type> symbols)
@@ -95,17 +290,42 @@ public:
         Nil,
         Object,
         Integer,
-        Real
+        Real,
+        Boolean
     };
 
-    Expr() : type_(Nil), s_(""), i_(0) {}
-    Expr(std::string const &v, Type t) : type_(t), s_(v) {}
-    Expr(int v) : type_(Integer), s_(""), i_(v) {}
-    Expr(long v) : type_(Integer), s_(""), i_(v) {}
-    Expr(double v) : type_(Real), s_(""), r_(v) {}
+    Expr() : type_(Nil), s_(""), i_(0), refs_(0), is_local_(is_local_refs())
+    {}
+    Expr(std::string const &v, Type t)
+        : type_(t), s_(v), refs_(0), is_local_(is_local_refs())
+    {}
+    Expr(int v)
+        : type_(Integer), s_(""), i_(v), refs_(0), is_local_(is_local_refs())
+    {}
+    Expr(long v)
+        : type_(Integer), s_(""), i_(v), refs_(0), is_local_(is_local_refs())
+    {}
+    Expr(double v)
+        : type_(Real), s_(""), r_(v), refs_(0), is_local_(is_local_refs())
+    {}
+    /// immediate of the type represented by the integer (Boolean)
+    Expr(long v, Type t)
+        : type_(t), s_(""), i_(v), refs_(0), is_local_(is_local_refs())
+    {}
 
     virtual ~Expr() {}
 
+    /// expressions are allocated from the pool, see cor::pool_allocate()
+    static void *operator new(size_t size) { return pool_allocate(size); }
+    static void operator delete(void *p, size_t size)
+    {
+        pool_deallocate(p, size);
+    }
+
+    /// use atomic reference counting even if the expression is created
+    /// in the LocalRefs scope, it should be called before sharing
+    void set_atomic_refs() { is_local_ = false; }
+
     std::string const& value() const
     {
         return s_;
@@ -137,6 +357,10 @@ protected:
     };
 
     friend expr_ptr eval(env_ptr env, expr_ptr src);
+    friend Value eval(env_ptr env, Value const &src);
+    friend void add_ref(Expr const *);
+    friend void release(Expr const *);
+    template <typename T> friend class ExprHandle;
 
     template <typename CharT> friend
     std::basic_ostream<CharT> & operator <<
@@ -147,8 +371,41 @@ protected:
 private:
     Expr(Expr &);
     Expr& operator =(Expr &);
+
+    // local counter is changed by the relaxed load/store w/o atomic
+    // read-modify-write
+    mutable std::atomic<long> refs_;
+    bool is_local_;
 };
 
+inline void add_ref(Expr const *p)
+{
+    if (p->is_local_)
+        p->refs_.store(p->refs_.load(std::memory_order_relaxed) + 1,
+                       std::memory_order_relaxed);
+    else
+        p->refs_.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline void release(Expr const *p)
+{
+    long left;
+    if (p->is_local_) {
+        left = p->refs_.load(std::memory_order_relaxed) - 1;
+        p->refs_.store(left, std::memory_order_relaxed);
+    } else {
+        left = p->refs_.fetch_sub(1, std::memory_order_acq_rel) - 1;
+    }
+    if (!left)
+        delete p;
+}
+
+template <typename T>
+long ExprHandle<T>::use_count() const
+{
+    return p_ ? p_->refs_.load(std::memory_order_relaxed) : 0;
+}
+
 template <typename CharT>
 std::basic_ostream<CharT> & operator <<
 (std::basic_ostream<CharT> &dst, Expr const &src)
@@ -162,6 +419,7 @@ std::basic_ostream<CharT> & operator <<
     case Expr::Nil: dst << "nil"; break;
     case Expr::Integer: dst << (long)src; break;
     case Expr::Real: dst << (double)src; break;
+    case Expr::Boolean: dst << ((long)src ? "true" : "false"); break;
     }
     return dst;
 }
@@ -170,7 +428,134 @@ extern template
 std::basic_ostream<char> & operator <<
 (std::basic_ostream<char> &dst, Expr const &src);
 
+/**
+ * Compact tagged value: integers, reals, booleans and nil are stored
+ * inline w/o any allocation, other expressions (strings, lists,
+ * functions, objects etc.) are referenced by the counted Expr
+ * pointer. Immediates have no identity, so the library immediate
+ * expressions (mk_value(), mk_boolean(), mk_nil()) are unboxed when
+ * converted to Value and boxed by to_expr() on demand.
+ *
+ * Value(true) is an integer as mk_value(true), use Value::boolean()
+ * for booleans
+ */
+class Value
+{
+public:
+    enum Kind {
+        /// the same as the null expr_ptr
+        Empty,
+        Nil,
+        Boolean,
+        Integer,
+        Real,
+        Ref
+    };
+
+    Value() : kind_(Empty) { data_.i = 0; }
+    Value(std::nullptr_t) : kind_(Empty) { data_.i = 0; }
+    Value(int v) : kind_(Integer) { data_.i = v; }
+    Value(long v) : kind_(Integer) { data_.i = v; }
+    Value(double v) : kind_(Real) { data_.r = v; }
+    Value(expr_ptr const &p);
+
+    Value(Value const &from) : kind_(from.kind_), data_(from.data_)
+    {
+        if (kind_ == Ref)
+            add_ref(data_.p);
+    }
+
+    Value(Value &&from) : kind_(from.kind_), data_(from.data_)
+    {
+        from.kind_ = Empty;
+    }
+
+    ~Value() { if (kind_ == Ref) release(data_.p); }
+
+    Value & operator =(Value from)
+    {
+        swap(from);
+        return *this;
+    }
+
+    void swap(Value &other)
+    {
+        std::swap(kind_, other.kind_);
+        std::swap(data_, other.data_);
+    }
+
+    static Value nil()
+    {
+        Value res;
+        res.kind_ = Nil;
+        return res;
+    }
+
+    static Value boolean(bool v)
+    {
+        Value res;
+        res.kind_ = Boolean;
+        res.data_.b = v;
+        return res;
+    }
+
+    Kind kind() const { return kind_; }
+    bool is_ref() const { return kind_ == Ref; }
+    explicit operator bool() const { return kind_ != Empty; }
+
+    /// type of the expression represented by the value, Nil for Empty
+    Expr::Type type() const
+    {
+        switch (kind_) {
+        case Boolean: return Expr::Boolean;
+        case Integer: return Expr::Integer;
+        case Real: return Expr::Real;
+        case Ref: return data_.p->type();
+        default: return Expr::Nil;
+        }
+    }
+
+    /// unchecked access to immediates, see to_long() etc.
+    long as_long() const { return data_.i; }
+    double as_double() const { return data_.r; }
+    bool as_bool() const { return data_.b; }
+
+    /// referenced expression or nullptr for immediates
+    Expr *expr() const { return kind_ == Ref ? data_.p : nullptr; }
+
+    /// expression representing the value, immediates are boxed
+    expr_ptr to_expr() const;
+
+private:
+    Kind kind_;
+    union Data {
+        long i;
+        double r;
+        bool b;
+        Expr *p;
+    } data_;
+};
+
+/// values are stored contiguously
+typedef std::vector<Value> value_list_type;
+
+template <typename CharT>
+std::basic_ostream<CharT> & operator <<
+(std::basic_ostream<CharT> &dst, Value const &src)
+{
+    switch (src.kind()) {
+    case Value::Empty: dst << "null"; break;
+    case Value::Nil: dst << "nil"; break;
+    case Value::Boolean: dst << (src.as_bool() ? "true" : "false"); break;
+    case Value::Integer: dst << src.as_long(); break;
+    case Value::Real: dst << src.as_double(); break;
+    case Value::Ref: dst << *src.expr(); break;
+    }
+    return dst;
+}
+
 expr_ptr eval(env_ptr env, expr_ptr src);
+Value eval(env_ptr env, Value const &src);
 
 /// evaluates list using environment env. Returns result list,
 /// std::move is considered to be used
@@ -225,22 +610,60 @@ class PodExpr : public Expr
 public:
     template <typename T>
     PodExpr(T v) : Expr(v) {}
+    PodExpr(long v, Type t) : Expr(v, t) {}
 protected:
     virtual expr_ptr do_eval(env_ptr, expr_ptr);
 };
 
+/// integer or real expression, bool values are integers
 template <typename T>
 expr_ptr mk_value(T v)
 {
     return expr_ptr(new PodExpr(v));
 }
 
+static inline expr_ptr mk_boolean(bool v)
+{
+    return expr_ptr(new PodExpr(long(v), Expr::Boolean));
+}
+
+/// only the library immediates are unboxed, the expression of the
+/// derived class is referenced to keep its dynamic type and evaluation
+inline Value::Value(expr_ptr const &p) : kind_(Ref)
+{
+    data_.p = p.get();
+    if (!data_.p) {
+        kind_ = Empty;
+        return;
+    }
+    auto const &t = typeid(*data_.p);
+    if (t == typeid(PodExpr)) {
+        switch (data_.p->type()) {
+        case Expr::Boolean: kind_ = Boolean; data_.b = (long)*p; return;
+        case Expr::Integer: kind_ = Integer; data_.i = (long)*p; return;
+        case Expr::Real: kind_ = Real; data_.r = (double)*p; return;
+        default: break;
+        }
+    } else if (t == typeid(BasicExpr<Expr::Nil>)) {
+        kind_ = Nil;
+        return;
+    }
+    add_ref(data_.p);
+}
+
 class SymbolExpr : public Expr
 {
 public:
-    SymbolExpr(std::string const &s) : Expr(s, Expr::Symbol) {}
+    SymbolExpr(std::string const &s)
+        : Expr(s, Expr::Symbol), id_(find_symbol(s))
+    {}
+
+    symbol_id id() const { return id_; }
 protected:
     virtual expr_ptr do_eval(env_ptr, expr_ptr);
+private:
+    // name can be interned after the symbol is created
+    symbol_id id_;
 };
 
 expr_ptr mk_symbol(std::string const &s);
@@ -250,6 +673,10 @@ class FunctionExpr : public Expr
 public:
     FunctionExpr(std::string const &name) : Expr(name, Expr::Function) {}
     virtual expr_ptr operator ()(env_ptr, expr_list_type &&) =0;
+
+    /// call with tagged values. By default values are boxed and passed
+    /// to operator (), see ValueLambdaExpr
+    virtual Value call(env_ptr, value_list_type &);
 };
 
 class LambdaExpr : public FunctionExpr
@@ -273,9 +700,43 @@ private:
 
 expr_ptr mk_lambda(std::string const &name, lambda_type const &fn);
 
+typedef std::function<Value (env_ptr, value_list_type&)> value_lambda_type;
+
+/// function accepting and returning tagged values, so numeric
+/// parameters and results are not allocated
+class ValueLambdaExpr : public FunctionExpr
+{
+public:
+    ValueLambdaExpr(std::string const &name,
+                    value_lambda_type fn)
+        : FunctionExpr(name),
+          fn(fn)
+    {}
+
+    virtual expr_ptr operator ()(env_ptr env, expr_list_type &&params);
+
+    virtual Value call(env_ptr env, value_list_type &params)
+    {
+        return fn(env, params);
+    }
+protected:
+    virtual expr_ptr do_eval(env_ptr, expr_ptr);
+private:
+    value_lambda_type fn;
+};
+
+expr_ptr mk_value_lambda(std::string const &name,
+                         value_lambda_type const &fn);
+
 void to_string(expr_ptr expr, std::string &dst);
 void to_long(expr_ptr expr, long &dst);
 void to_double(expr_ptr expr, double &dst);
+void to_bool(expr_ptr expr, bool &dst);
+
+void to_string(Value const &v, std::string &dst);
+void to_long(Value const &v, long &dst);
+void to_double(Value const &v, double &dst);
+void to_bool(Value const &v, bool &dst);
 
 template <typename T>
 void convert(expr_ptr, T &dst);
@@ -286,6 +747,12 @@ static inline Env::item_type mk_record
     return std::make_pair(name, mk_lambda(name, fn));
 }
 
+static inline Env::item_type mk_value_record
+(std::string const &name, value_lambda_type const &fn)
+{
+    return std::make_pair(name, mk_value_lambda(name, fn));
+}
+
 static inline Env::item_type mk_const
 (std::string const &name, std::string const &val)
 {
@@ -304,6 +771,7 @@ expr_ptr default_atom_convert(std::string &&s);
 class Interpreter
 {
 public:
+    typedef StringRef token_type;
     typedef std::function<expr_ptr (std::string &&)> atom_converter_type;
     Interpreter
     (env_ptr env,
@@ -311,45 +779,67 @@ public:
 
     Interpreter(Interpreter &&from)
         : env(from.env)
-        , stack(std::move(from.stack))
+        , values_(std::move(from.values_))
+        , frames_(std::move(from.frames_))
+        , results_(std::move(from.results_))
+        , is_finished_(from.is_finished_)
         , convert_atom(from.convert_atom)
+        , is_default_convert(from.is_default_convert)
     {}
 
     void on_list_begin()
     {
-        stack.push(expr_list_type());
+        is_finished_ = false;
+        frames_.push_back(values_.size());
     }
 
     void on_list_end();
 
-    void on_comment(std::string &&s) { }
+    // there is no on_comment(), so comments are skipped by the parser
 
-    void on_string(std::string &&s) {
-        stack.top().push_back(mk_string(s));
+    void on_string(StringRef &&s) {
+        is_finished_ = false;
+        values_.push_back(mk_string(s.str()));
     }
 
-    void on_atom(std::string &&s);
+    /// with the default converter numbers and keywords are classified
+    /// w/o copying the atom, custom converter gets the original text
+    void on_atom(StringRef &&s);
 
-    void on_eof() {
-    }
+    void on_eof();
+
+    /// top-level results of all parsed input, immediates are boxed
+    /// when the input is finished (on_eof()), so the list and its
+    /// items are the same for all calls until more input is parsed
+    expr_list_type const& results() const;
 
-    expr_list_type const& results() const
+    /// top-level results as tagged values
+    value_list_type const& values() const
     {
         if (empty())
             throw Error("Interpreter has not any results");
 
-        return stack.top();
+        return values_;
     }
 
     bool empty() const
     {
-        return stack.empty();
+        return frames_.empty();
     }
 
 private:
     env_ptr env;
-    std::stack<expr_list_type> stack;
+    // items of all open lists, nested list items are on the top
+    value_list_type values_;
+    // positions of open lists items in values_
+    std::vector<size_t> frames_;
+    // reused for parameters of calls
+    value_list_type params_;
+    // boxed values_, built by on_eof()
+    expr_list_type results_;
+    bool is_finished_;
     atom_converter_type convert_atom;
+    bool is_default_convert;
 };
 
 class ObjectExpr : public Expr
@@ -374,7 +864,7 @@ public:
     expr_ptr required();
 
     template <typename T>
-    std::shared_ptr<T> required();
+    ExprHandle<T> required();
 
     /// access required parameters list member, write result using
     /// convert function to dst. \return this object to allow chained
@@ -398,6 +888,35 @@ private:
 
 ListAccessor & operator >> (ListAccessor &src, expr_ptr dst);
 
+/// the same as ListAccessor for parameters of ValueLambdaExpr
+class ValueAccessor
+{
+public:
+
+    ValueAccessor(value_list_type const& params)
+        : cur(params.begin()),
+          end(params.end())
+    {}
+
+    bool has_more() const { return cur != end; }
+
+    Value const &required();
+
+    template <typename T>
+    ValueAccessor& required(void (*convert)(Value const &, T &dst), T &dst)
+    {
+        convert(required(), dst);
+        return *this;
+    }
+
+    bool optional(Value &dst);
+
+private:
+
+    value_list_type::const_iterator cur;
+    value_list_type::const_iterator end;
+};
+
 template <typename T>
 ListAccessor& ListAccessor::required(void (*convert)(expr_ptr, T &dst), T &dst)
 {
@@ -406,9 +925,9 @@ ListAccessor& ListAccessor::required(void (*convert)(expr_ptr, T &dst), T &dst)
 }
 
 template <typename T>
-std::shared_ptr<T> ListAccessor::required()
+ExprHandle<T> ListAccessor::required()
 {
-    return std::dynamic_pointer_cast<T>(required());
+    return dynamic_pointer_cast<T>(required());
 }
 
 template <typename ConsumerT>
@@ -429,7 +948,7 @@ void rest_casted(ListAccessor &src, FnT fn)
 {
     rest(src,
          [&fn](expr_ptr p) {
-             auto res = std::dynamic_pointer_cast<T>(p);
+             auto res = dynamic_pointer_cast<T>(p);
              if (!res)
                  throw Error("Can't be casted");
              fn(res);
@@ -470,7 +989,7 @@ void push_rest_casted(ListAccessor &src, T &dst) {
     typedef typename T::value_type ptr_type;
     typedef typename ptr_type::element_type cast_type;
     auto fn = [](expr_ptr from) {
-        auto res = std::dynamic_pointer_cast<cast_type>(from);
+        auto res = dynamic_pointer_cast<cast_type>(from);
         if (!res)
             throw Error("Can't be casted");
         return res;
@@ -494,12 +1013,12 @@ protected:
 
 static inline expr_ptr mk_list(expr_list_type &params)
 {
-    return std::make_shared<List>(params);
+    return expr_ptr(new List(params));
 }
 
 static inline expr_ptr mk_list(expr_list_type &&params)
 {
-    return std::make_shared<List>(std::move(params));
+    return expr_ptr(new List(std::move(params)));
 }
 
 }} // cor::notlisp
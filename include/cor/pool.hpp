@@ -0,0 +1,96 @@
+#ifndef _COR_POOL_HPP_
+#define _COR_POOL_HPP_
+
+#include <cstddef>
+#include <new>
+#include <utility>
+
+namespace cor
+{
+
+/// blocks of size up to pool_max_size are allocated from the pool
+static const size_t pool_max_size = 256;
+
+/**
+ * Allocate the small block from the pool: each thread has its own
+ * free lists of blocks for size classes (multiple of 16 bytes), lists
+ * are refilled from the global lists or by chunks of blocks, so most
+ * allocations and deallocations are just free list operations. Blocks
+ * can be freed by any thread. Chunks are never returned to the
+ * system, so pool memory is the peak of used blocks; free blocks of
+ * the finished threads are passed to other threads.
+ *
+ * Larger blocks are allocated by the operator new.
+ */
+void *pool_allocate(size_t size);
+
+/// release the block allocated by pool_allocate() with the same size
+void pool_deallocate(void *p, size_t size);
+
+/// count of chunks allocated by the pool, used to check pool usage
+size_t pool_chunks();
+
+/// stateless allocator using pool_allocate() for single objects
+template <typename T>
+class PoolAllocator
+{
+public:
+    typedef T value_type;
+    typedef T *pointer;
+    typedef T const *const_pointer;
+    typedef T &reference;
+    typedef T const &const_reference;
+    typedef size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+
+    template <typename U>
+    struct rebind
+    {
+        typedef PoolAllocator<U> other;
+    };
+
+    PoolAllocator() {}
+    template <typename U>
+    PoolAllocator(PoolAllocator<U> const &) {}
+
+    T *allocate(size_t n, void const * = nullptr)
+    {
+        return static_cast<T*>(n == 1 ? pool_allocate(sizeof(T))
+                               : ::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T *p, size_t n)
+    {
+        if (n == 1)
+            pool_deallocate(p, sizeof(T));
+        else
+            ::operator delete(p);
+    }
+
+    size_t max_size() const { return size_t(-1) / sizeof(T); }
+
+    template <typename U, typename ... Args>
+    void construct(U *p, Args&& ...args)
+    {
+        ::new(static_cast<void*>(p)) U(std::forward<Args>(args)...);
+    }
+
+    template <typename U>
+    void destroy(U *p) { p->~U(); }
+};
+
+template <typename T, typename U>
+bool operator ==(PoolAllocator<T> const &, PoolAllocator<U> const &)
+{
+    return true;
+}
+
+template <typename T, typename U>
+bool operator !=(PoolAllocator<T> const &, PoolAllocator<U> const &)
+{
+    return false;
+}
+
+}
+
+#endif // _COR_POOL_HPP_
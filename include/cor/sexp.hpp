@@ -36,10 +36,16 @@
 #include <stack>
 #include <deque>
 #include <sstream>
+#include <type_traits>
+#include <algorithm>
+#include <limits>
+#include <stdint.h>
 
 namespace cor {
 namespace sexp {
 
+using cor::StringRef;
+
 template <typename ... Args>
 std::string mk_sexp_err_msg(std::basic_istream<char> &src,
                             char const *info, Args ... args)
@@ -48,6 +54,13 @@ std::string mk_sexp_err_msg(std::basic_istream<char> &src,
                   mk_error_message(info, args...));
 }
 
+template <typename ... Args>
+std::string mk_sexp_err_msg(size_t pos, char const *info, Args ... args)
+{
+    return concat("error parsing S-exp, pos ", pos, ": ",
+                  mk_error_message(info, args...));
+}
+
 class Error : public cor::Error
 {
 public:
@@ -57,6 +70,12 @@ public:
         , pos(src.tellg())
     {}
 
+    template <typename ... Args>
+    Error(size_t pos, char const *info, Args ... args)
+        : cor::Error(mk_sexp_err_msg(pos, info, args...))
+        , pos(pos)
+    {}
+
     size_t pos;
 };
 
@@ -73,9 +92,470 @@ int char2hex(CharT c)
     return -1;
 };
 
+/// kinds of atoms recognized by classify_atom()
+enum AtomKind {
+    symbol_atom,
+    integer_atom,
+    real_atom,
+    keyword_atom
+};
+
+/// strtod() for [src, src + len) using C locale
+double c_strtod(char const *src, size_t len);
+
+/**
+ * format the real using C locale as the shortest text converted back
+ * by c_strtod() to the same value. Integral values get ".0", so the
+ * text is classified as the real atom. Infinity and NaN are formatted
+ * as "inf" and "nan", they are classified as symbols. Buffer of 32
+ * bytes is enough
+ *
+ * @return length of the text written to dst
+ */
+size_t c_dtostr(double v, char *dst, size_t size);
+
+template <typename CharT>
+double c_strtod(CharT const *src, size_t len)
+{
+    // characters are already checked to be ASCII number ones
+    return c_strtod(std::string(src, src + len).c_str(), len);
+}
+
+/**
+ * classify atom text: integer is [+-]digits fitting into long, real is
+ * [+-]digits[.digits][(e|E)[+-]digits] (or starting from the '.'),
+ * keyword starts from ':', all other atoms are symbols. Numbers are
+ * parsed w/o allocations and do not depend on the locale
+ *
+ * @param i integer value, set only for integer_atom
+ * @param r real value, set only for real_atom
+ */
+template <typename CharT>
+AtomKind classify_atom(CharT const *p, CharT const *end, long &i, double &r)
+{
+    static double const pow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    // significant digits which are accumulated in uint64_t w/o overflow
+    static const int max_digits = 19;
+
+    if (p == end)
+        return symbol_atom;
+    if (*p == ':')
+        return keyword_atom;
+
+    auto begin = p;
+    bool is_negative = (*p == '-');
+    if (*p == '-' || *p == '+')
+        ++p;
+
+    uint64_t m = 0;
+    int digits = 0, exp10 = 0;
+    bool has_digits = false, is_exact = true, is_real = false;
+    auto mantissa_digit = [&](unsigned d, bool is_fraction) {
+        has_digits = true;
+        if (!m && !d) {
+            // leading zeroes
+            exp10 -= is_fraction;
+        } else if (digits < max_digits) {
+            m = m * 10 + d;
+            ++digits;
+            exp10 -= is_fraction;
+        } else {
+            is_exact = false;
+            exp10 += !is_fraction;
+        }
+    };
+    auto digit = [](CharT c) { return unsigned(c) - '0'; };
+
+    for (; p != end && digit(*p) < 10; ++p)
+        mantissa_digit(digit(*p), false);
+    if (p != end && *p == '.') {
+        is_real = true;
+        for (++p; p != end && digit(*p) < 10; ++p)
+            mantissa_digit(digit(*p), true);
+    }
+    if (!has_digits)
+        return symbol_atom;
+
+    if (p != end && (*p == 'e' || *p == 'E')) {
+        is_real = true;
+        ++p;
+        bool is_negative_exp = (p != end && *p == '-');
+        if (p != end && (*p == '-' || *p == '+'))
+            ++p;
+        if (p == end)
+            return symbol_atom;
+        int e = 0;
+        for (; p != end && digit(*p) < 10; ++p)
+            if (e < 100000)
+                e = e * 10 + digit(*p);
+        exp10 += is_negative_exp ? -e : e;
+    }
+    if (p != end)
+        return symbol_atom;
+
+    if (!is_real && is_exact) {
+        uint64_t limit = uint64_t(std::numeric_limits<long>::max())
+            + (is_negative ? 1 : 0);
+        if (m <= limit) {
+            i = is_negative ? long(0 - m) : long(m);
+            return integer_atom;
+        }
+        // out of range integers are reals
+    }
+
+    // exact conversion: mantissa and power of 10 are represented
+    // exactly as double, so the result is correctly rounded
+    if (is_exact && digits <= 15 && exp10 >= -22 && exp10 <= 22) {
+        r = double(m);
+        r = exp10 < 0 ? r / pow10[-exp10] : r * pow10[exp10];
+        if (is_negative)
+            r = -r;
+    } else {
+        r = c_strtod(begin, end - begin);
+    }
+    return real_atom;
+}
+
 template <typename CharT, typename HandlerT>
 extern void parse(std::basic_istream<CharT> &src, HandlerT &handler);
 
+/// parse s-expressions from the memory buffer [src, src + len),
+/// sexp::Error::pos is an offset in the buffer
+template <typename CharT, typename HandlerT>
+extern void parse(CharT const *src, size_t len, HandlerT &handler);
+
+template <typename CharT, typename HandlerT>
+void parse(std::basic_string<CharT> const &src, HandlerT &handler)
+{
+    parse(src.data(), src.size(), handler);
+}
+
+/// parse file mapped into memory, sexp::Error::pos is an offset in
+/// the file
+template <typename HandlerT>
+extern void parse_file(std::string const &path, HandlerT &handler);
+
+/// handler callbacks on_list_begin(), on_atom(), on_string() and
+/// on_comment() may return Action instead of void to control parsing
+enum Action {
+    proceed,
+    /// skip the rest of the current list w/o tokenizing it. If it is
+    /// returned by on_list_begin() the whole list is skipped. Handler
+    /// gets on_list_end() for the skipped list. Ignored at the top level
+    skip_list
+};
+
+/// Handler receives tokens (atoms, strings, comments) as rvalue
+/// std::string by default. If handler declares
+///
+///     typedef cor::sexp::StringRef token_type;
+///
+/// tokens are passed as StringRef instead. Reference points directly
+/// into the parsed buffer if the token is not escaped and is not split
+/// between parsed chunks, otherwise to the parser internal buffer. So
+/// it is valid only until the handler method returns.
+///
+/// Token callbacks are optional: if handler has no on_comment() (or
+/// on_string(), on_atom()) accepting the token, such tokens are skipped
+/// by the parser without collecting their text. Handler can also get
+/// typed atoms, see has_typed_atoms, and strings by chunks, see
+/// has_string_chunks
+template <typename HandlerT, typename CharT = char>
+class HandlerTraits
+{
+    template <typename T>
+    static typename std::is_same
+    <typename T::token_type, BasicStringRef<CharT> >::type
+    test_refs(T *);
+
+    template <typename T>
+    static std::false_type test_refs(...);
+
+public:
+    static const bool use_refs = decltype(test_refs<HandlerT>(nullptr))::value;
+
+    typedef typename std::conditional
+    <use_refs, BasicStringRef<CharT>, std::basic_string<CharT> >::type
+    token_type;
+
+private:
+    template <typename T>
+    static auto test_atoms(T *p)
+        -> decltype(p->on_atom(std::declval<token_type>()),
+                    std::true_type());
+    template <typename T>
+    static std::false_type test_atoms(...);
+
+    template <typename T>
+    static auto test_strings(T *p)
+        -> decltype(p->on_string(std::declval<token_type>()),
+                    std::true_type());
+    template <typename T>
+    static std::false_type test_strings(...);
+
+    template <typename T>
+    static auto test_string_chunks(T *p)
+        -> decltype(p->on_string_chunk(std::declval<token_type>()),
+                    p->on_string_end(), std::true_type());
+    template <typename T>
+    static std::false_type test_string_chunks(...);
+
+    template <typename T>
+    static std::integral_constant<size_t, T::string_chunk_size>
+    test_chunk_size(T *);
+    template <typename T>
+    static std::integral_constant<size_t, 64 * 1024> test_chunk_size(...);
+
+    template <typename T>
+    static auto test_comments(T *p)
+        -> decltype(p->on_comment(std::declval<token_type>()),
+                    std::true_type());
+    template <typename T>
+    static std::false_type test_comments(...);
+
+    template <typename T>
+    static auto test_integers(T *p)
+        -> decltype(p->on_integer(std::declval<long>()), std::true_type());
+    template <typename T>
+    static std::false_type test_integers(...);
+
+    template <typename T>
+    static auto test_reals(T *p)
+        -> decltype(p->on_real(std::declval<double>()), std::true_type());
+    template <typename T>
+    static std::false_type test_reals(...);
+
+    template <typename T>
+    static auto test_keywords(T *p)
+        -> decltype(p->on_keyword(std::declval<token_type>()),
+                    std::true_type());
+    template <typename T>
+    static std::false_type test_keywords(...);
+
+public:
+    typedef decltype(test_atoms<HandlerT>(nullptr)) has_atoms_type;
+    typedef decltype(test_strings<HandlerT>(nullptr)) has_strings_type;
+    typedef decltype(test_string_chunks<HandlerT>(nullptr))
+    has_string_chunks_type;
+    typedef decltype(test_comments<HandlerT>(nullptr)) has_comments_type;
+    typedef decltype(test_integers<HandlerT>(nullptr)) has_integers_type;
+    typedef decltype(test_reals<HandlerT>(nullptr)) has_reals_type;
+    typedef decltype(test_keywords<HandlerT>(nullptr)) has_keywords_type;
+
+    static const bool has_atoms = has_atoms_type::value;
+    static const bool has_strings = has_strings_type::value;
+    /// strings are passed by chunks if handler has
+    /// on_string_chunk(token_type) and on_string_end(), on_string() is
+    /// not used then. String is passed as zero or more non-empty chunks
+    /// followed by on_string_end(), only the latter can return
+    /// Action. Chunks are not longer than the handler static member
+    /// string_chunk_size (64K by default) and all of them except the
+    /// last one have exactly this length, so the parser does not
+    /// accumulate more than a chunk of the string
+    static const bool has_string_chunks = has_string_chunks_type::value;
+    static const size_t string_chunk_size
+    = decltype(test_chunk_size<HandlerT>(nullptr))::value;
+    static const bool has_comments = has_comments_type::value;
+    static const bool has_integers = has_integers_type::value;
+    static const bool has_reals = has_reals_type::value;
+    static const bool has_keywords = has_keywords_type::value;
+    /// atoms are classified by classify_atom() if handler has any of
+    /// on_integer(long), on_real(double), on_keyword(token_type). Atoms
+    /// of kinds w/o such callbacks are passed to on_atom()
+    static const bool has_typed_atoms = has_integers || has_reals
+        || has_keywords;
+
+    /// pass token to the handler if it accepts such tokens
+    /// @return true if handler requested to skip the rest of the list
+    template <typename T>
+    static bool atom(HandlerT &h, T &&v)
+    {
+        return typed_atom
+            (h, std::forward<T>(v),
+             std::integral_constant<bool, has_typed_atoms>());
+    }
+
+    static bool integer(HandlerT &h, long v)
+    {
+        return integer(h, v, has_integers_type());
+    }
+
+    static bool real(HandlerT &h, double v)
+    {
+        return real(h, v, has_reals_type());
+    }
+
+    /// the whole string is passed as chunks if the handler accepts them
+    template <typename T>
+    static bool string(HandlerT &h, T &&v)
+    {
+        return chunked_string
+            (h, std::forward<T>(v), has_string_chunks_type());
+    }
+
+    /// pass the next string chunk to the handler accepting chunks,
+    /// string is finished by string_end()
+    static void string_chunk(HandlerT &h, CharT const *p, size_t len)
+    {
+        string_chunk(h, p, len, has_string_chunks_type());
+    }
+
+    /// @return true if handler requested to skip the rest of the list
+    static bool string_end(HandlerT &h)
+    {
+        return string_end(h, has_string_chunks_type());
+    }
+
+    template <typename T>
+    static bool comment(HandlerT &h, T &&v)
+    {
+        return comment(h, std::forward<T>(v), has_comments_type());
+    }
+
+    /// @return true if handler requested to skip the list
+    static bool list_begin(HandlerT &h)
+    {
+        return invoke([&h]() { return h.on_list_begin(); });
+    }
+
+private:
+    template <typename T>
+    static bool typed_atom(HandlerT &h, T &&v, std::false_type)
+    {
+        return atom(h, std::forward<T>(v), has_atoms_type());
+    }
+
+    template <typename T>
+    static bool typed_atom(HandlerT &h, T &&v, std::true_type)
+    {
+        long i;
+        double r;
+        auto begin = v.data(), end = begin + v.size();
+        switch (classify_atom(begin, end, i, r)) {
+        case integer_atom:
+            if (has_integers)
+                return integer(h, i, has_integers_type());
+            break;
+        case real_atom:
+            if (has_reals)
+                return real(h, r, has_reals_type());
+            break;
+        case keyword_atom:
+            if (has_keywords)
+                return keyword(h, token_type(begin + 1, v.size() - 1),
+                               has_keywords_type());
+            break;
+        default:
+            break;
+        }
+        return atom(h, std::forward<T>(v), has_atoms_type());
+    }
+
+    template <typename T>
+    static bool chunked_string(HandlerT &h, T &&v, std::false_type)
+    {
+        return string(h, std::forward<T>(v), has_strings_type());
+    }
+
+    template <typename T>
+    static bool chunked_string(HandlerT &h, T &&v, std::true_type)
+    {
+        size_t const chunk_size = string_chunk_size;
+        auto p = v.data();
+        for (auto end = p + v.size(); p != end;) {
+            size_t len = std::min<size_t>(end - p, chunk_size);
+            string_chunk(h, p, len);
+            p += len;
+        }
+        return string_end(h);
+    }
+
+    static void string_chunk(HandlerT &h, CharT const *p, size_t len,
+                             std::true_type)
+    {
+        h.on_string_chunk(token_type(p, len));
+    }
+
+    static void string_chunk(HandlerT &, CharT const *, size_t,
+                             std::false_type) {}
+
+    static bool string_end(HandlerT &h, std::true_type)
+    {
+        return invoke([&h]() { return h.on_string_end(); });
+    }
+
+    static bool string_end(HandlerT &, std::false_type) { return false; }
+
+    static bool integer(HandlerT &h, long v, std::true_type)
+    {
+        return invoke([&h, v]() { return h.on_integer(v); });
+    }
+
+    static bool real(HandlerT &h, double v, std::true_type)
+    {
+        return invoke([&h, v]() { return h.on_real(v); });
+    }
+
+    static bool keyword(HandlerT &h, token_type &&v, std::true_type)
+    {
+        return invoke([&h, &v]() { return h.on_keyword(std::move(v)); });
+    }
+
+    static bool integer(HandlerT &, long, std::false_type) { return false; }
+    static bool real(HandlerT &, double, std::false_type) { return false; }
+    static bool keyword(HandlerT &, token_type &&, std::false_type)
+    {
+        return false;
+    }
+
+    template <typename FnT>
+    static bool invoke(FnT const &fn)
+    {
+        return invoke(fn, std::is_same<decltype(fn()), Action>());
+    }
+
+    template <typename FnT>
+    static bool invoke(FnT const &fn, std::true_type)
+    {
+        return fn() == skip_list;
+    }
+
+    template <typename FnT>
+    static bool invoke(FnT const &fn, std::false_type)
+    {
+        fn();
+        return false;
+    }
+
+    template <typename T>
+    static bool atom(HandlerT &h, T &&v, std::true_type)
+    {
+        return invoke([&h, &v]() { return h.on_atom(std::forward<T>(v)); });
+    }
+
+    template <typename T>
+    static bool string(HandlerT &h, T &&v, std::true_type)
+    {
+        return invoke([&h, &v]() { return h.on_string(std::forward<T>(v)); });
+    }
+
+    template <typename T>
+    static bool comment(HandlerT &h, T &&v, std::true_type)
+    {
+        return invoke([&h, &v]() { return h.on_comment(std::forward<T>(v)); });
+    }
+
+    template <typename T>
+    static bool atom(HandlerT &, T &&, std::false_type) { return false; }
+    template <typename T>
+    static bool string(HandlerT &, T &&, std::false_type) { return false; }
+    template <typename T>
+    static bool comment(HandlerT &, T &&, std::false_type) { return false; }
+};
+
 /// interface can be inherited by a handler in the case parser is used
 /// for multiply handlers to avoid multiply instantiations
 class AbstractHandler {
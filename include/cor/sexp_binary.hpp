@@ -0,0 +1,332 @@
+#ifndef _COR_SEXP_BINARY_HPP_
+#define _COR_SEXP_BINARY_HPP_
+
+#include <cor/sexp.hpp>
+#include <cor/sexp_writer.hpp>
+
+#include <cmath>
+#include <string>
+#include <type_traits>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+
+namespace cor {
+namespace sexp {
+
+/**
+ * Binary encoding of s-expressions. Each item starts from the tag
+ * byte:
+ *
+ * - '(' and ')' - list begin and end
+ * - 'a', 's', 'c' - atom, string, comment: length (unsigned LEB128)
+ *   followed by bytes as is, w/o escaping
+ * - 'i' - integer: zigzag-encoded LEB128 of int64
+ * - 'r' - real: IEEE 754 double, little endian. Only finite values
+ *   are allowed: text has no syntax for infinity and NaN, "inf" and
+ *   "nan" atoms are symbols
+ */
+namespace binary {
+
+enum Tag {
+    tag_list_begin = '(',
+    tag_list_end = ')',
+    tag_atom = 'a',
+    tag_string = 's',
+    tag_comment = 'c',
+    tag_integer = 'i',
+    tag_real = 'r'
+};
+
+/// max length of the encoded 64-bit varint
+static const size_t max_varint_len = 10;
+
+static inline char *put_varint(char *dst, uint64_t v)
+{
+    for (; v >= 0x80; v >>= 7)
+        *dst++ = char(v | 0x80);
+    *dst++ = char(v);
+    return dst;
+}
+
+/// @return pointer after the varint or nullptr if input is truncated
+static inline char const *get_varint
+(char const *p, char const *end, uint64_t &v)
+{
+    v = 0;
+    for (unsigned shift = 0; p != end && shift < 64; shift += 7) {
+        auto c = (unsigned char)*p++;
+        v |= uint64_t(c & 0x7f) << shift;
+        if (!(c & 0x80))
+            return p;
+    }
+    return nullptr;
+}
+
+static inline uint64_t zigzag(int64_t v)
+{
+    return (uint64_t(v) << 1) ^ uint64_t(v >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t v)
+{
+    return int64_t(v >> 1) ^ -int64_t(v & 1);
+}
+
+/// write decimal representation of v to dst, which should have space
+/// for 20 characters at least
+/// @return end of the written data
+static inline char *format_integer(char *dst, int64_t v)
+{
+    uint64_t u = v < 0 ? 0 - uint64_t(v) : uint64_t(v);
+    char buf[20], *p = buf + sizeof(buf);
+    do {
+        *--p = char('0' + u % 10);
+        u /= 10;
+    } while (u);
+    if (v < 0)
+        *dst++ = '-';
+    auto len = buf + sizeof(buf) - p;
+    memcpy(dst, p, len);
+    return dst + len;
+}
+
+/// integer atom is encoded as integer if it is written in the canonical
+/// form, so text is restored as is: decimal w/o leading zeroes and '+'
+bool parse_integer(StringRef const &s, int64_t &v);
+
+}
+
+/**
+ * Handler writing s-expressions in the binary encoding, atoms looking
+ * like canonical integers are encoded as integers. Typed values are
+ * written by put_integer() and put_real(), they are not handler
+ * callbacks, so text atoms are encoded as they are written. Output is
+ * accumulated in the OutputBuffer, it is flushed on on_eof()
+ */
+class BinaryWriter
+{
+public:
+    typedef StringRef token_type;
+
+    BinaryWriter() {}
+    BinaryWriter(int fd, size_t batch_size = 64 * 1024)
+        : out_(fd, batch_size) {}
+
+    void on_list_begin() { put(binary::tag_list_begin); }
+    void on_list_end() { put(binary::tag_list_end); }
+    void on_comment(StringRef &&s) { put(binary::tag_comment, s); }
+    void on_string(StringRef &&s) { put(binary::tag_string, s); }
+    void on_atom(StringRef &&s);
+    void put_integer(int64_t v);
+    void put_real(double v);
+    void on_eof() { out_.flush(); }
+
+    void flush() { out_.flush(); }
+
+    StringRef data() const { return out_.data(); }
+    std::string str() const { return out_.str(); }
+
+private:
+    BinaryWriter(BinaryWriter const &);
+    BinaryWriter & operator =(BinaryWriter const &);
+
+    void put(binary::Tag tag)
+    {
+        auto p = out_.reserve(1);
+        *p++ = tag;
+        out_.commit(p);
+    }
+
+    void put(binary::Tag tag, StringRef const &s);
+
+    OutputBuffer out_;
+};
+
+namespace binary {
+
+template <typename HandlerT>
+class Reader
+{
+public:
+    Reader(HandlerT &handler, char const *src, size_t len)
+        : handler_(handler), begin_(src), end_(src + len)
+    {}
+
+    void parse()
+    {
+        unsigned level = 0;
+        for (auto p = begin_; p != end_;) {
+            auto tag_pos = p;
+            bool is_skip = false;
+            uint64_t v;
+            switch (*p++) {
+            case tag_list_begin:
+                ++level;
+                is_skip = traits_type::list_begin(handler_);
+                break;
+            case tag_list_end:
+                if (!level)
+                    throw Error(tag_pos - begin_, "Unexpected ')'");
+                --level;
+                handler_.on_list_end();
+                break;
+            case tag_atom:
+                p = get_token(p, v);
+                is_skip = traits_type::atom
+                    (handler_, token(p - v, v, use_refs_type()));
+                break;
+            case tag_string:
+                p = get_token(p, v);
+                is_skip = traits_type::string
+                    (handler_, token(p - v, v, use_refs_type()));
+                break;
+            case tag_comment:
+                p = get_token(p, v);
+                is_skip = traits_type::comment
+                    (handler_, token(p - v, v, use_refs_type()));
+                break;
+            case tag_integer: {
+                p = get(p, v);
+                if (traits_type::has_integers) {
+                    is_skip = traits_type::integer(handler_, unzigzag(v));
+                    break;
+                }
+                char buf[24];
+                auto n = format_integer(buf, unzigzag(v)) - buf;
+                is_skip = traits_type::atom
+                    (handler_, token(buf, n, use_refs_type()));
+                break;
+            }
+            case tag_real: {
+                double r;
+                p = get_real(p, r);
+                if (traits_type::has_reals) {
+                    is_skip = traits_type::real(handler_, r);
+                    break;
+                }
+                char buf[32];
+                auto n = c_dtostr(r, buf, sizeof(buf));
+                is_skip = traits_type::atom
+                    (handler_, token(buf, n, use_refs_type()));
+                break;
+            }
+            default:
+                throw Error(tag_pos - begin_, "Unknown tag %d", *tag_pos);
+            }
+            if (is_skip && level) {
+                p = skip(p);
+                --level;
+                handler_.on_list_end();
+            }
+        }
+        if (level)
+            throw Error(end_ - begin_, "Not closed list");
+        handler_.on_eof();
+    }
+
+private:
+    typedef HandlerTraits<HandlerT> traits_type;
+    typedef std::integral_constant
+    <bool, traits_type::use_refs> use_refs_type;
+
+    char const *get(char const *p, uint64_t &v)
+    {
+        auto res = get_varint(p, end_, v);
+        if (!res)
+            throw Error(p - begin_, "Truncated varint");
+        return res;
+    }
+
+    char const *get_token(char const *p, uint64_t &len)
+    {
+        p = get(p, len);
+        if (uint64_t(end_ - p) < len)
+            throw Error(p - begin_, "Truncated token");
+        return p + len;
+    }
+
+    char const *get_real(char const *p, double &r)
+    {
+        if (end_ - p < 8)
+            throw Error(p - begin_, "Truncated real");
+        uint64_t v = 0;
+        for (int i = 7; i >= 0; --i)
+            v = (v << 8) | (unsigned char)p[i];
+        memcpy(&r, &v, sizeof(r));
+        if (!std::isfinite(r))
+            throw Error(p - begin_, "Not finite real");
+        return p + 8;
+    }
+
+    /// skip the rest of the list, tokens are skipped using their length
+    /// @return position after the list end
+    char const *skip(char const *p)
+    {
+        unsigned level = 0;
+        while (p != end_) {
+            auto tag_pos = p;
+            uint64_t v;
+            double r;
+            switch (*p++) {
+            case tag_list_begin:
+                ++level;
+                break;
+            case tag_list_end:
+                if (!level)
+                    return p;
+                --level;
+                break;
+            case tag_atom:
+            case tag_string:
+            case tag_comment:
+                p = get_token(p, v);
+                break;
+            case tag_integer:
+                p = get(p, v);
+                break;
+            case tag_real:
+                p = get_real(p, r);
+                break;
+            default:
+                throw Error(tag_pos - begin_, "Unknown tag %d", *tag_pos);
+            }
+        }
+        throw Error(end_ - begin_, "Not closed list");
+    }
+
+    static StringRef token(char const *p, size_t len, std::true_type)
+    {
+        return StringRef(p, len);
+    }
+
+    static std::string token(char const *p, size_t len, std::false_type)
+    {
+        return std::string(p, len);
+    }
+
+    HandlerT &handler_;
+    char const *begin_;
+    char const *end_;
+};
+
+}
+
+/// parse binary encoded s-expressions, numbers are passed to the
+/// handler on_integer() and on_real() if they are present, otherwise as
+/// atoms. sexp::Error::pos is an offset in the buffer
+template <typename HandlerT>
+void parse_binary(char const *src, size_t len, HandlerT &handler)
+{
+    binary::Reader<HandlerT>(handler, src, len).parse();
+}
+
+template <typename HandlerT>
+void parse_binary(std::string const &src, HandlerT &handler)
+{
+    parse_binary(src.data(), src.size(), handler);
+}
+
+}}
+
+#endif // _COR_SEXP_BINARY_HPP_
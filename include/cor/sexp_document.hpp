@@ -0,0 +1,185 @@
+#ifndef _COR_SEXP_DOCUMENT_HPP_
+#define _COR_SEXP_DOCUMENT_HPP_
+
+#include <cor/sexp.hpp>
+
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+namespace cor {
+namespace sexp {
+
+/**
+ * Read-only parsed s-expressions stored as a flat tape. Atoms and
+ * strings are copied into the single string arena, tape entries refer
+ * to them by offset. List begin and end entries refer to each other,
+ * so skipping to the next sibling is O(1). Comments are not stored
+ * (skipped by the parser).
+ *
+ * Document is a parser handler itself:
+ *
+ *     sexp::Document doc;
+ *     sexp::parse(data, size, doc);
+ *     auto v = doc.root().find("name").first().next();
+ *
+ * Top-level forms are represented as items of the implicit list, so
+ * root() is the first top-level form. Values refer to the document
+ * object, so they are invalidated if the document is moved.
+ */
+class Document
+{
+public:
+    typedef StringRef token_type;
+
+    enum Kind {
+        List,
+        ListEnd,
+        Atom,
+        String
+    };
+
+    /// tape entry. For tokens pos is an offset in the arena, for
+    /// lists - index of the matching begin/end entry
+    struct Entry
+    {
+        uint32_t kind;
+        uint32_t size;
+        size_t pos;
+    };
+
+    class Value;
+
+    /// @param size_hint expected source size, used to preallocate storage
+    Document(size_t size_hint = 0);
+    Document(Document &&from);
+
+    /// first top-level form or the end of the document. Document
+    /// should be complete (on_eof() is called)
+    Value root() const;
+
+    /// top-level form looking like (name ...) or the end of the document
+    Value find(StringRef const &name) const;
+
+    size_t size() const { return tape_.size(); }
+    Entry const &operator [](size_t i) const { return tape_[i]; }
+
+    StringRef token(size_t i) const
+    {
+        auto const &e = tape_[i];
+        return StringRef(arena_.data() + e.pos, e.size);
+    }
+
+    void on_list_begin();
+    void on_list_end();
+    void on_string(StringRef &&s) { add(String, s); }
+    void on_atom(StringRef &&s) { add(Atom, s); }
+    void on_eof();
+
+private:
+    Document(Document const &);
+    Document & operator =(Document const &);
+
+    void add(Kind, StringRef const &);
+
+    std::vector<Entry> tape_;
+    std::string arena_;
+    std::vector<size_t> open_;
+};
+
+/// lightweight cursor pointing to the document tape entry
+class Document::Value
+{
+public:
+    Value(Document const &doc, size_t index)
+        : doc_(&doc), index_(index) {}
+
+    Kind kind() const { return Kind(entry().kind); }
+    size_t index() const { return index_; }
+
+    bool is_end() const { return kind() == ListEnd; }
+    bool is_list() const { return kind() == List; }
+    bool is_atom() const { return kind() == Atom; }
+    bool is_string() const { return kind() == String; }
+
+    /// atom or string value, empty for lists
+    StringRef value() const
+    {
+        return (is_atom() || is_string()) ? doc_->token(index_) : StringRef();
+    }
+
+    /// next sibling or the end of the enclosing list, should not be
+    /// called for the end
+    Value next() const
+    {
+        auto const &e = entry();
+        return Value(*doc_, (e.kind == List ? e.pos : index_) + 1);
+    }
+
+    /// first list item or the end of the list (of the document for
+    /// non-lists)
+    Value first() const
+    {
+        return is_list() ? Value(*doc_, index_ + 1) : end();
+    }
+
+    /// n-th list item or the end of the list
+    Value at(size_t n) const;
+
+    /// count of list items, O(count)
+    size_t count() const;
+
+    /// list item which is a list starting from the atom name, smth.
+    /// like (name ...), or the end of the list
+    Value find(StringRef const &name) const
+    {
+        return first().find_sibling(name);
+    }
+
+    /// this value or the next sibling looking like (name ...) or the
+    /// end of the enclosing list
+    Value find_sibling(StringRef const &name) const;
+
+    bool operator ==(Value const &other) const
+    {
+        return doc_ == other.doc_ && index_ == other.index_;
+    }
+    bool operator !=(Value const &other) const { return !(*this == other); }
+
+private:
+    Entry const &entry() const { return (*doc_)[index_]; }
+
+    /// end of the list or the end of the document for non-lists
+    Value end() const
+    {
+        return is_list() ? Value(*doc_, entry().pos)
+            : Value(*doc_, doc_->size() - 1);
+    }
+
+    Document const *doc_;
+    size_t index_;
+};
+
+inline Document::Value Document::root() const
+{
+    if (tape_.empty())
+        throw cor::Error("sexp::Document is not complete");
+    return Value(*this, 0);
+}
+
+inline Document::Value Document::find(StringRef const &name) const
+{
+    return root().find_sibling(name);
+}
+
+/// parse s-expressions from the buffer into the document
+Document mk_document(char const *src, size_t len);
+
+static inline Document mk_document(std::string const &src)
+{
+    return mk_document(src.data(), src.size());
+}
+
+}}
+
+#endif // _COR_SEXP_DOCUMENT_HPP_
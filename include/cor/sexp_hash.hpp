@@ -0,0 +1,137 @@
+#ifndef _COR_SEXP_HASH_HPP_
+#define _COR_SEXP_HASH_HPP_
+
+#include <cor/sexp.hpp>
+
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+namespace cor {
+namespace sexp {
+
+/**
+ * Merkle tree of s-expressions: parser handler computing the content
+ * hash of every list while parsing. List hash depends on its items in
+ * order: atoms and strings by their text, nested lists by their hashes,
+ * so equal lists have equal hashes in any documents and changed data
+ * changes hashes of all enclosing lists. Comments and formatting do not
+ * affect hashes. Hash is stable between runs and platforms but it is
+ * not cryptographic.
+ *
+ *     sexp::HashTree before, after;
+ *     sexp::parse(old_data, before);
+ *     sexp::parse(new_data, after);
+ *     for (auto const &c : sexp::diff(before, after))
+ *         reload(after.node(c.to));
+ *
+ * Node 0 is the implicit list of top-level forms, so its hash is the
+ * hash of the whole document.
+ */
+class HashTree
+{
+public:
+    typedef StringRef token_type;
+    typedef uint64_t hash_type;
+
+    static const size_t npos = size_t(-1);
+
+    struct Node
+    {
+        hash_type hash;
+        /// hash of direct atoms and strings only
+        hash_type items_hash;
+        size_t parent;
+        size_t first_child;
+        size_t next_sibling;
+        /// index of the list beginning in the token sequence: the same
+        /// as sexp::Document entry index for the same input
+        size_t index;
+        /// list head atom (name of (name ...)) in the names arena
+        size_t head_pos;
+        size_t head_size;
+        bool has_head;
+    };
+
+    HashTree();
+
+    size_t size() const { return nodes_.size(); }
+    Node const &node(size_t i) const { return nodes_[i]; }
+    hash_type hash() const { return nodes_[0].hash; }
+
+    /// list head or empty reference if list does not start from the atom
+    StringRef head(size_t i) const
+    {
+        auto const &n = nodes_[i];
+        return StringRef(heads_.data() + n.head_pos, n.head_size);
+    }
+
+    void on_list_begin();
+    void on_list_end();
+    void on_atom(StringRef &&s) { add(Atom, s); }
+    void on_string(StringRef &&s) { add(String, s); }
+    void on_eof();
+
+private:
+    enum ItemKind {
+        Atom = 1,
+        String,
+        List
+    };
+
+    /// state of the list being parsed
+    struct Open
+    {
+        size_t node;
+        size_t last_child;
+        hash_type state;
+        hash_type items_state;
+        size_t count;
+    };
+
+    void add(ItemKind kind, StringRef const &s);
+    void begin(size_t parent);
+    void end();
+
+    std::vector<Node> nodes_;
+    std::vector<Open> open_;
+    std::string heads_;
+    // count of events, see Node::index
+    size_t events_;
+};
+
+/// difference between lists of two hash trees
+struct Change
+{
+    enum Kind {
+        /// list exists only in the new tree
+        Added,
+        /// list exists only in the old tree
+        Removed,
+        /// list is changed but it is not described by changes of nested
+        /// lists: its atoms/strings or order of nested lists are changed
+        Changed
+    };
+
+    Kind kind;
+    /// node index in the old tree or HashTree::npos
+    size_t from;
+    /// node index in the new tree or HashTree::npos
+    size_t to;
+};
+
+/**
+ * find changed lists. Only lists with different hashes are compared,
+ * so the time is proportional to the size of the difference and the
+ * count of items of changed lists, not to the size of trees.
+ *
+ * Nested lists of the changed list are matched by hashes first (equal
+ * lists are unchanged even if they are moved), the rest is matched by
+ * the head atom in order and compared recursively, unmatched lists are
+ * added or removed.
+ */
+std::vector<Change> diff(HashTree const &from, HashTree const &to);
+
+}}
+
+#endif // _COR_SEXP_HASH_HPP_
@@ -1,178 +1,919 @@
+#ifndef _COR_SEXP_IMPL_HPP_
+#define _COR_SEXP_IMPL_HPP_
+
 #include <cor/sexp.hpp>
+#include <cor/mmap.hpp>
+
+#include <type_traits>
 
 namespace cor {
 namespace sexp {
 
+/// classes of characters interesting for the parser
+enum CharClass {
+    char_other = 0,
+    char_space,
+    char_newline,
+    // classes below are structural, see scan_structure()
+    char_list_begin,
+    char_list_end,
+    char_quote,
+    char_comment,
+    char_escape
+};
 
-template <typename CharT, typename HandlerT>
-void parse(std::basic_istream<CharT> &src, HandlerT &handler)
+template <typename T = void>
+struct Tables
 {
-    enum Action {
-        Stay,
-        Skip
-    };
-    const int eos = -1;
-    typedef std::function<Action (int)> parser_t;
-    parser_t rule, top, in_string, in_atom, in_comment,
-        append_escaped, append_escaped_hex;
-    stack<parser_t> ctx;
-    unsigned level = 0;
-
-    std::string data;
-    int hex_byte;
-
-    auto rule_use = [&](parser_t const &p) {
-        data = "";
-        data.reserve(256);
-        rule = p;
-    };
+    /// CharClass of each 8-bit character
+    static unsigned char const char_class[256];
+    /// value of the escaped character, 0 if it is used literally
+    static char const escaped[256];
+};
 
-    auto rule_pop = [&]() {
-        auto p = ctx.top();
-        ctx.pop();
-        rule = p;
-    };
+template <typename T>
+unsigned char const Tables<T>::char_class[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 1, 1, 1, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 0, 5, 0, 0, 0, 0, 0, 3, 4, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 6, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 7, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+template <typename T>
+char const Tables<T>::escaped[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, '\a', '\b', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, '\n', 0,
+    0, 0, '\r', 0, '\t', 0, '\v', 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+template <typename CharT>
+CharClass char_class(CharT c)
+{
+    typedef typename std::make_unsigned<CharT>::type uchar_type;
+    uchar_type u = static_cast<uchar_type>(c);
+    return (u < 256) ? static_cast<CharClass>(Tables<>::char_class[u])
+        : char_other;
+}
+
+template <typename CharT>
+CharT unescape(CharT c)
+{
+    typedef typename std::make_unsigned<CharT>::type uchar_type;
+    uchar_type u = static_cast<uchar_type>(c);
+    char v = (u < 256) ? Tables<>::escaped[u] : 0;
+    return v ? v : c;
+}
+
+/// return the first character terminating atom body
+template <typename CharT>
+CharT const *scan_atom(CharT const *p, CharT const *end)
+{
+    for (; p != end; ++p) {
+        auto cls = char_class(*p);
+        if (cls != char_other && cls != char_quote && cls != char_comment)
+            break;
+    }
+    return p;
+}
 
-    auto rule_push = [&](parser_t const &after,
-                         parser_t const &current) {
-        ctx.push(after);
-        rule = current;
+/// return the first character terminating string body
+template <typename CharT>
+CharT const *scan_string(CharT const *p, CharT const *end)
+{
+    for (; p != end; ++p) {
+        auto cls = char_class(*p);
+        if (cls == char_quote || cls == char_escape)
+            break;
+    }
+    return p;
+}
+
+/// return the first character terminating comment body
+template <typename CharT>
+CharT const *scan_comment(CharT const *p, CharT const *end)
+{
+    for (; p != end && *p != '\n'; ++p) {}
+    return p;
+}
+
+/// return the first character which can change list nesting level:
+/// parenthesis, start of string or comment, escape
+template <typename CharT>
+CharT const *scan_structure(CharT const *p, CharT const *end)
+{
+    for (; p != end; ++p) {
+        auto cls = char_class(*p);
+        if (cls >= char_list_begin)
+            break;
+    }
+    return p;
+}
+
+/// set of functions used to find next interesting character
+template <typename CharT>
+struct Scanner
+{
+    typedef CharT const *(*scan_type)(CharT const *, CharT const *);
+
+    scan_type atom;
+    scan_type string;
+    scan_type comment;
+    scan_type structure;
+};
+
+enum ScanImpl {
+    scan_scalar,
+    scan_sse2,
+    scan_avx2
+};
+
+/// get scanner implementation for char input, returns nullptr if it is
+/// not supported by the CPU or by the library build
+Scanner<char> const *get_scanner(ScanImpl impl);
+
+/// scanner used by the parser
+template <typename CharT>
+Scanner<CharT> const &default_scanner()
+{
+    static const Scanner<CharT> res = {
+        &scan_atom<CharT>, &scan_string<CharT>, &scan_comment<CharT>,
+        &scan_structure<CharT>
     };
+    return res;
+}
 
-    top = [&](int c) -> Action {
-        if (c == ')') {
+/// for char input the best implementation supported by CPU is chosen
+template <>
+Scanner<char> const &default_scanner<char>();
+
+/// item found by scan_item()
+template <typename CharT>
+struct ScannedItem
+{
+    CharT const *begin;
+    CharT const *end;
+    /// the first atom of the list
+    CharT const *head;
+    size_t head_size;
+    bool is_head_escaped;
+};
+
+/// skip the atom body, escaped characters are included
+template <typename CharT>
+CharT const *skip_atom(CharT const *p, CharT const *end, bool &is_escaped,
+                       Scanner<CharT> const &scan)
+{
+    while (true) {
+        p = scan.atom(p, end);
+        if (p == end || char_class(*p) != char_escape)
+            return p;
+        // hex digits of \x are ordinary atom characters
+        if (end - p < 2)
+            return end;
+        is_escaped = true;
+        p += 2;
+    }
+}
+
+/**
+ * find the end of the item starting at p: only structure is tracked
+ * (nesting, strings, comments, escapes) like by
+ * ParserImpl::skip_step(), tokens are not collected
+ *
+ * @param level nesting level at p, if it is not 0 the rest of the
+ * list is scanned up to and including its end
+ * @return false if item is not complete: it is still being written
+ * or it is continued by the next input block
+ */
+template <typename CharT>
+bool scan_item(CharT const *begin, CharT const *p, CharT const *end,
+               ScannedItem<CharT> &item, unsigned level = 0,
+               Scanner<CharT> const &scan = default_scanner<CharT>())
+{
+    bool is_first = false;
+    item.begin = p;
+    item.head = nullptr;
+    item.head_size = 0;
+    item.is_head_escaped = false;
+    while (p != end) {
+        switch (char_class(*p)) {
+        case char_space:
+        case char_newline:
+            ++p;
+            continue;
+        case char_list_begin:
             if (!level)
-                throw Error(src, "Unexpected ')'");
-            --level;
-            handler.on_list_end();
-        } else if (c == '(') {
+                item.begin = p;
             ++level;
-            handler.on_list_begin();
-        } else if (c == ';') {
-            rule_use(in_comment);
-        } else if (::isspace(c)) {
-            // do nothing
-        } else if (c == '"') {
-            rule_use(in_string);
-        } else if (c != eos) {
-            rule_use(in_atom);
-            return Stay;
-        }
-        return Skip;
+            ++p;
+            is_first = (level == 1);
+            continue;
+        case char_list_end:
+            if (!level)
+                throw Error(p - begin, "Unexpected list end");
+            ++p;
+            is_first = false;
+            if (--level)
+                continue;
+            break;
+        case char_quote:
+            for (++p; ; p += 2) {
+                p = scan.string(p, end);
+                if (p == end || char_class(*p) == char_quote)
+                    break;
+                if (end - p < 2)
+                    return false;
+            }
+            if (p == end)
+                return false;
+            ++p;
+            is_first = false;
+            break;
+        case char_comment:
+            p = scan.comment(p, end);
+            if (p == end)
+                return false;
+            ++p;
+            break;
+        default: {
+            auto atom = p;
+            bool is_escaped = false;
+            p = skip_atom(p, end, is_escaped, scan);
+            // atom can be continued
+            if (p == end)
+                return false;
+            if (is_first) {
+                item.head = atom;
+                item.head_size = p - atom;
+                item.is_head_escaped = is_escaped;
+            }
+            is_first = false;
+            break;
+        }
+        }
+        if (!level) {
+            item.end = p;
+            return true;
+        }
+    }
+    return false;
+}
+
+/// parser state machine: consumes input character by character and
+/// calls handler methods when tokens are recognized
+template <typename CharT, typename HandlerT>
+class ParserImpl
+{
+public:
+    ParserImpl(HandlerT &handler, size_t pos = 0)
+        : handler_(handler)
+        , state_(Top)
+        , after_escape_(Top)
+        , level_(0)
+        , skip_level_(0)
+        , is_skip_atom_(false)
+        , hex_(0)
+        , pos_(pos)
+        , scan_(default_scanner<CharT>())
+    {}
+
+    void step(CharT c);
+    void feed(CharT const *begin, CharT const *end, bool is_last = false);
+    void end();
+
+    size_t position() const { return pos_; }
+    unsigned level() const { return level_; }
+
+private:
+    enum State {
+        Top,
+        Atom,
+        String,
+        Comment,
+        Escape,
+        HexFirst,
+        HexSecond,
+        // the rest of the list is skipped, see skip_step()
+        Skip,
+        SkipString,
+        SkipComment,
+        SkipEscape
     };
 
-    in_comment = [&](int c) -> Action {
-        if (c != '\n' && c != eos) {
-            data += c;
-        } else {
-            handler.on_comment(std::move(data));
-            rule_use(top);
-        }
-        return Skip;
+    enum Token {
+        atom_token,
+        string_token,
+        comment_token
     };
 
-    auto in_hex = [&](int c) -> Action {
-        if (c != eos) {
-            int n = char2hex(c);
-            if (n >= 0) {
-                if (hex_byte < 0) {
-                    hex_byte = (n << 4);
-                    return Skip;
-                }
-                hex_byte |= n;
-            }
+    typedef std::basic_string<CharT> string_type;
+    typedef BasicStringRef<CharT> ref_type;
+    typedef HandlerTraits<HandlerT, CharT> traits_type;
+    typedef std::integral_constant
+    <bool, traits_type::use_refs> use_refs_type;
+
+    /// text of tokens not accepted by the handler is not collected
+    static bool is_used(Token token)
+    {
+        switch (token) {
+        case atom_token:
+            return traits_type::has_atoms || traits_type::has_typed_atoms;
+        case string_token:
+            return traits_type::has_strings || traits_type::has_string_chunks;
+        default:
+            return traits_type::has_comments;
         }
-        rule_pop();
-        return Stay;
-    };
+    }
 
-    append_escaped_hex = [&](int) -> Action {
-        if (hex_byte < 0)
-            throw Error(src, "Escaped hex is empty");
+    static Token token_of(State state)
+    {
+        switch (state) {
+        case Atom:
+            return atom_token;
+        case String:
+            return string_token;
+        default:
+            return comment_token;
+        }
+    }
 
-        data += static_cast<char>(hex_byte);
-        rule_pop();
-        return Stay;
-    };
+    static bool is_chunked(Token token)
+    {
+        return token == string_token && traits_type::has_string_chunks;
+    }
 
-    auto process_hex = [&](parser_t const &after) -> Action {
-        hex_byte = -1;
-        rule_push(after, in_hex);
-        return Skip;
-    };
+    void collect(Token token, CharT c)
+    {
+        if (!is_used(token))
+            return;
+        data_ += c;
+        if (is_chunked(token) && data_.size() >= traits_type::string_chunk_size)
+            flush_chunk();
+    }
+
+    void collect(Token token, CharT const *begin, CharT const *end)
+    {
+        if (!is_used(token))
+            return;
+        if (is_chunked(token))
+            collect_chunks(begin, end);
+        else
+            data_.append(begin, end - begin);
+    }
+
+    /// full chunks of the string are passed to the handler at once,
+    /// only the incomplete one is accumulated in data_
+    void collect_chunks(CharT const *begin, CharT const *end)
+    {
+        size_t const chunk_size = traits_type::string_chunk_size;
+        if (!data_.empty()) {
+            auto len = std::min<size_t>(chunk_size - data_.size(), end - begin);
+            data_.append(begin, len);
+            begin += len;
+            if (data_.size() < chunk_size)
+                return;
+            flush_chunk();
+        }
+        for (; size_t(end - begin) >= chunk_size; begin += chunk_size)
+            traits_type::string_chunk(handler_, begin, chunk_size);
+        data_.append(begin, end - begin);
+    }
 
-    append_escaped = [&](int c) -> Action {
-        static const std::unordered_map<char, char>
-        assoc{{'n', '\n'}, {'t', '\t'}, {'r', '\r'}, {'a', '\a'},
-              {'b', '\b'}, {'v', '\v'}};
+    void flush_chunk()
+    {
+        traits_type::string_chunk(handler_, data_.data(), data_.size());
+        data_.clear();
+    }
 
-        if (c == eos)
-            throw Error(src, "Expected escaped symbol, got EOS");
+    template <typename ... Args>
+    void error(char const *info, Args ... args)
+    {
+        throw Error(pos_, info, args...);
+    }
 
-        if (c == 'x')
-            return process_hex(append_escaped_hex);
+    void escape(State after)
+    {
+        after_escape_ = after;
+        state_ = Escape;
+    }
 
-        auto p = assoc.find(c);
-        if (p != assoc.end()) {
-            data += p->second;
-        } else {
-            data += c;
+    void unescaped(CharT c)
+    {
+        collect(token_of(after_escape_), c);
+        state_ = after_escape_;
+    }
+
+    template <typename T>
+    void deliver(Token token, T &&v)
+    {
+        bool is_skip = false;
+        switch (token) {
+        case atom_token:
+            is_skip = traits_type::atom(handler_, std::forward<T>(v));
+            break;
+        case string_token:
+            is_skip = traits_type::string(handler_, std::forward<T>(v));
+            break;
+        case comment_token:
+            is_skip = traits_type::comment(handler_, std::forward<T>(v));
+            break;
         }
-        rule_pop();
-        return Skip;
-    };
+        if (is_skip)
+            skip();
+    }
 
-    auto process_escaped = [&]() -> Action {
-        rule_push(rule, append_escaped);
-        return Skip;
-    };
+    /// skip the rest of the current list if it is not the top level
+    void skip()
+    {
+        if (!level_)
+            return;
+        state_ = Skip;
+        skip_level_ = level_;
+        is_skip_atom_ = false;
+    }
 
-    in_atom = [&](int c) -> Action {
-        static const std::string bound("()");
-        if (bound.find(c) != std::string::npos || isspace(c) || c == eos) {
-            handler.on_atom(std::move(data));
-            rule_use(top);
-            return Stay;
-        } else if (c == '\\') {
-            return process_escaped();
-        } else {
-            data += c;
+    void skip_step(CharT c);
+    CharT const *skip_run(CharT const *p, CharT const *end);
+
+    /// deliver token accumulated in data_
+    void emit(Token token)
+    {
+        if (is_used(token))
+            emit(token, use_refs_type());
+    }
+
+    void emit(Token token, std::false_type)
+    {
+        deliver(token, std::move(data_));
+        data_.clear();
+    }
+
+    void emit(Token token, std::true_type)
+    {
+        deliver(token, ref_type(data_));
+        data_.clear();
+    }
+
+    /// deliver token placed in the input [begin, end)
+    void emit(Token token, CharT const *begin, CharT const *end)
+    {
+        if (is_used(token))
+            emit(token, begin, end, use_refs_type());
+    }
+
+    void emit(Token token, CharT const *begin, CharT const *end,
+              std::false_type)
+    {
+        deliver(token, string_type(begin, end));
+    }
+
+    void emit(Token token, CharT const *begin, CharT const *end,
+              std::true_type)
+    {
+        deliver(token, ref_type(begin, end - begin));
+    }
+
+    HandlerT &handler_;
+    State state_;
+    State after_escape_;
+    unsigned level_;
+    // list on this level is skipped
+    unsigned skip_level_;
+    // last skipped character is a part of an atom
+    bool is_skip_atom_;
+    int hex_;
+    size_t pos_;
+    Scanner<CharT> scan_;
+    string_type data_;
+};
+
+template <typename CharT, typename HandlerT>
+void ParserImpl<CharT, HandlerT>::step(CharT c)
+{
+    ++pos_;
+    while (true) {
+        switch (state_) {
+        case Top:
+            switch (char_class(c)) {
+            case char_space:
+            case char_newline:
+                break;
+            case char_list_begin:
+                ++level_;
+                if (traits_type::list_begin(handler_))
+                    skip();
+                break;
+            case char_list_end:
+                if (!level_)
+                    error("Unexpected ')'");
+                --level_;
+                handler_.on_list_end();
+                break;
+            case char_comment:
+                state_ = Comment;
+                break;
+            case char_quote:
+                state_ = String;
+                break;
+            case char_escape:
+                escape(Atom);
+                break;
+            default:
+                state_ = Atom;
+                collect(atom_token, c);
+                break;
+            }
+            return;
+        case Atom:
+            switch (char_class(c)) {
+            case char_space:
+            case char_newline:
+            case char_list_begin:
+            case char_list_end:
+                // handler can switch to skipping
+                state_ = Top;
+                emit(atom_token);
+                continue;
+            case char_escape:
+                escape(Atom);
+                break;
+            default:
+                collect(atom_token, c);
+                break;
+            }
+            return;
+        case String:
+            switch (char_class(c)) {
+            case char_quote:
+                state_ = Top;
+                emit(string_token);
+                break;
+            case char_escape:
+                escape(String);
+                break;
+            default:
+                collect(string_token, c);
+                break;
+            }
+            return;
+        case Comment:
+            if (c == '\n') {
+                state_ = Top;
+                emit(comment_token);
+            } else {
+                collect(comment_token, c);
+            }
+            return;
+        case Escape:
+            if (c == 'x')
+                state_ = HexFirst;
+            else
+                unescaped(unescape(c));
+            return;
+        case HexFirst:
+            hex_ = char2hex(c);
+            if (hex_ < 0)
+                error("Escaped hex is empty");
+            state_ = HexSecond;
+            return;
+        case HexSecond: {
+            int n = char2hex(c);
+            if (n >= 0) {
+                unescaped(static_cast<CharT>((hex_ << 4) | n));
+                return;
+            }
+            // single hex digit, current character is not a part of it
+            unescaped(static_cast<CharT>(hex_));
+            continue;
         }
-        return Skip;
-    };
+        default:
+            skip_step(c);
+            return;
+        }
+    }
+}
 
-    in_string = [&](int c) -> Action {
-        if (c == '"') {
-            handler.on_string(std::move(data));
-            rule_use(top);
-        } else if (c == '\\') {
-            return process_escaped();
-        } else if (c == eos) {
-            throw Error(src, "string is not limited, got EOS");
-        } else {
-            data += c;
+/// skipping is a simplified parsing: only list nesting is tracked,
+/// strings, comments and escapes are recognized only to find where
+/// they end. Quote and semicolon inside an atom are its characters
+template <typename CharT, typename HandlerT>
+void ParserImpl<CharT, HandlerT>::skip_step(CharT c)
+{
+    switch (state_) {
+    case Skip:
+        switch (char_class(c)) {
+        case char_list_begin:
+            ++level_;
+            is_skip_atom_ = false;
+            break;
+        case char_list_end:
+            --level_;
+            is_skip_atom_ = false;
+            if (level_ < skip_level_) {
+                state_ = Top;
+                handler_.on_list_end();
+            }
+            break;
+        case char_quote:
+            if (!is_skip_atom_)
+                state_ = SkipString;
+            break;
+        case char_comment:
+            if (!is_skip_atom_)
+                state_ = SkipComment;
+            break;
+        case char_escape:
+            after_escape_ = Skip;
+            state_ = SkipEscape;
+            break;
+        case char_space:
+        case char_newline:
+            is_skip_atom_ = false;
+            break;
+        default:
+            is_skip_atom_ = true;
+            break;
         }
-        return Skip;
-    };
+        break;
+    case SkipString:
+        if (char_class(c) == char_quote) {
+            state_ = Skip;
+            is_skip_atom_ = false;
+        } else if (char_class(c) == char_escape) {
+            after_escape_ = SkipString;
+            state_ = SkipEscape;
+        }
+        break;
+    case SkipComment:
+        if (c == '\n') {
+            state_ = Skip;
+            is_skip_atom_ = false;
+        }
+        break;
+    default: // SkipEscape, hex digits of \x are ordinary characters
+        state_ = after_escape_;
+        is_skip_atom_ = true;
+        break;
+    }
+}
 
-    rule_use(top);
-    try {
-        while (true) {
-            CharT c = src.get();
-            if (src.gcount() == 0) {
-                rule(eos);
-                break;
+/// skip characters till the end of the skipped list or the end of the
+/// input, only structural characters are processed by skip_step()
+template <typename CharT, typename HandlerT>
+CharT const *ParserImpl<CharT, HandlerT>::skip_run
+(CharT const *p, CharT const *end)
+{
+    while (p != end) {
+        CharT const *run = p;
+        switch (state_) {
+        case Skip:
+            p = scan_.structure(p, end);
+            if (p != run) {
+                auto cls = char_class(p[-1]);
+                is_skip_atom_ = (cls != char_space && cls != char_newline);
             }
-            
-            while (rule(c) == Stay) {}
+            break;
+        case SkipString:
+            p = scan_.string(p, end);
+            break;
+        case SkipComment:
+            p = scan_.comment(p, end);
+            break;
+        case SkipEscape:
+            break;
+        default:
+            return p;
         }
-    } catch (Error const &e) {
-        throw;
-    } catch (std::exception const &e) {
-        throw;
+        if (p == end)
+            break;
+        skip_step(*p++);
     }
-    handler.on_eof();
+    return p;
 }
 
+/// consumes [begin, end) range, the same as step() for each character
+/// but tokens are scanned by runs of characters. Tokens without
+/// escapes are delivered directly from the input range. If is_last is
+/// set there is no more input after this range, so the last token is
+/// also delivered directly
+template <typename CharT, typename HandlerT>
+void ParserImpl<CharT, HandlerT>::feed
+(CharT const *begin, CharT const *end, bool is_last)
+{
+    size_t base = pos_;
+    CharT const *p = begin;
+    while (p != end) {
+        CharT const *run = p;
+        Token token = atom_token;
+        switch (state_) {
+        case Top:
+            if (char_class(*p) == char_other) {
+                // atom body is scanned below
+                state_ = Atom;
+                continue;
+            }
+            pos_ = base + (p - begin);
+            step(*p++);
+            continue;
+        case Atom:
+            p = scan_.atom(p, end);
+            token = atom_token;
+            break;
+        case String:
+            p = scan_.string(p, end);
+            token = string_token;
+            break;
+        case Comment:
+            p = scan_.comment(p, end);
+            token = comment_token;
+            break;
+        case Skip:
+        case SkipString:
+        case SkipComment:
+        case SkipEscape:
+            pos_ = base + (p - begin);
+            p = skip_run(p, end);
+            continue;
+        default:
+            pos_ = base + (p - begin);
+            step(*p++);
+            continue;
+        }
+
+        if (p == end) {
+            if (is_last && data_.empty() && token != string_token) {
+                state_ = Top;
+                emit(token, run, p);
+            } else {
+                collect(token, run, p);
+            }
+            break;
+        }
+
+        if (token != comment_token && char_class(*p) == char_escape) {
+            collect(token, run, p);
+            pos_ = base + (p - begin);
+            step(*p++);
+            continue;
+        }
+
+        CharT const *token_end = p;
+        // atom delimiter is processed in the Top (or Skip) state
+        if (token != atom_token)
+            ++p;
+        // handler can switch to skipping
+        state_ = Top;
+        if (data_.empty()) {
+            emit(token, run, token_end);
+        } else {
+            collect(token, run, token_end);
+            emit(token);
+        }
+    }
+    pos_ = base + (end - begin);
+}
+
+template <typename CharT, typename HandlerT>
+void ParserImpl<CharT, HandlerT>::end()
+{
+    switch (state_) {
+    case Top:
+        break;
+    case Atom:
+        emit(atom_token);
+        break;
+    case Comment:
+        emit(comment_token);
+        break;
+    case String:
+        error("string is not limited, got EOS");
+        break;
+    case Escape:
+        error("Expected escaped symbol, got EOS");
+        break;
+    case HexFirst:
+        error("Escaped hex is empty");
+        break;
+    case HexSecond:
+        unescaped(static_cast<CharT>(hex_));
+        end();
+        return;
+    case Skip:
+    case SkipComment:
+        break;
+    case SkipString:
+        error("string is not limited, got EOS");
+        break;
+    case SkipEscape:
+        error("Expected escaped symbol, got EOS");
+        break;
+    }
+    data_.clear();
+    state_ = Top;
+    handler_.on_eof();
+}
+
+template <typename CharT, typename HandlerT>
+void parse(std::basic_istream<CharT> &src, HandlerT &handler)
+{
+    typedef std::basic_istream<CharT> stream_type;
+    typedef typename stream_type::traits_type traits_type;
+
+    typename stream_type::sentry is_ready(src, true);
+    auto start = is_ready ? src.tellg() : typename stream_type::pos_type(-1);
+    ParserImpl<CharT, HandlerT> impl(handler, start < 0 ? 0 : size_t(start));
+    if (is_ready) {
+        auto buf = src.rdbuf();
+        for (auto c = buf->sbumpc(); !traits_type::eq_int_type
+                 (c, traits_type::eof()); c = buf->sbumpc())
+            impl.step(traits_type::to_char_type(c));
+    }
+    src.setstate(std::ios_base::eofbit | std::ios_base::failbit);
+    impl.end();
+}
+
+template <typename CharT, typename HandlerT>
+void parse(CharT const *src, size_t len, HandlerT &handler)
+{
+    ParserImpl<CharT, HandlerT> impl(handler);
+    impl.feed(src, src + len, true);
+    impl.end();
+}
+
+template <typename HandlerT>
+void parse_file(std::string const &path, HandlerT &handler)
+{
+    MappedFile src(path);
+    parse(src.data(), src.size(), handler);
+}
+
+
+/// Incremental parser, input is fed by chunks when it is available
+/// (e.g. read from non-blocking fd). Parser state (nesting level,
+/// partially read token) is kept between feed() calls, so handler is
+/// called as soon as a token is complete. After an exception parser
+/// state is undefined
+template <typename HandlerT, typename CharT = char>
+class PushParser
+{
+public:
+    PushParser(HandlerT &handler) : impl_(handler) {}
+
+    void feed(CharT const *src, size_t len)
+    {
+        impl_.feed(src, src + len);
+    }
+
+    void feed(std::basic_string<CharT> const &src)
+    {
+        feed(src.data(), src.size());
+    }
+
+    /// there is no more input: last token is delivered and
+    /// handler.on_eof() is called
+    void finish()
+    {
+        impl_.end();
+    }
+
+    /// count of characters consumed
+    size_t position() const { return impl_.position(); }
+
+    /// nesting level of lists, 0 if all lists are closed
+    unsigned level() const { return impl_.level(); }
+
+private:
+    PushParser(PushParser const &);
+    PushParser & operator =(PushParser const &);
+
+    ParserImpl<CharT, HandlerT> impl_;
+};
 
 }}
+
+#endif // _COR_SEXP_IMPL_HPP_
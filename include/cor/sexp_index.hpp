@@ -0,0 +1,101 @@
+#ifndef _COR_SEXP_INDEX_HPP_
+#define _COR_SEXP_INDEX_HPP_
+
+#include <cor/sexp_impl.hpp>
+
+#include <string>
+#include <unordered_map>
+
+namespace cor {
+namespace sexp {
+
+/**
+ * Index of top-level forms in the append-only s-expressions file:
+ * maps key (the first atom) of each top-level list like (key ...) to
+ * its position in the file, so a single form can be parsed w/o parsing
+ * the whole file. If there are several forms with the same key, the
+ * last one is indexed.
+ *
+ * Index is stored in the sidecar file path + ".idx" as s-expressions.
+ * update() indexes only forms appended since the last update and
+ * appends them to the sidecar. If data file is shrunk it is reindexed
+ * from the beginning, other modifications of already indexed data are
+ * not detected. Incomplete form at the end of the file (e.g. with the
+ * unterminated string) is not indexed, the next update starts from it.
+ * Forms are found by tracking only the structure, tokens are not
+ * collected
+ *
+ *     sexp::Index index("data.sexp");
+ *     index.update();
+ *     index.parse("record-key", handler);
+ */
+class Index
+{
+public:
+    /// form position in the data file
+    struct Entry
+    {
+        size_t offset;
+        size_t size;
+    };
+
+    /// sidecar is loaded if it exists, index is not updated
+    Index(std::string const &path);
+
+    /// index forms appended to the data file since the last update and
+    /// save them to the sidecar
+    /// @return count of new indexed forms
+    size_t update();
+
+    /// @return position of the last form with the key or nullptr
+    Entry const *find(std::string const &key) const;
+
+    /// parse the last form with the key, sexp::Error::pos is an offset
+    /// in the data file
+    /// @return false if there is no such form
+    template <typename HandlerT>
+    bool parse(std::string const &key, HandlerT &handler) const;
+
+    /// count of indexed keys
+    size_t size() const { return keys_.size(); }
+
+    /// size of the data file part which is indexed
+    size_t indexed_size() const { return indexed_; }
+
+    std::string const &index_path() const { return index_path_; }
+
+private:
+    Index(Index const &);
+    Index & operator =(Index const &);
+
+    void load();
+    void reset();
+
+    std::string path_;
+    std::string index_path_;
+    std::unordered_map<std::string, Entry> keys_;
+    size_t indexed_;
+    // sidecar contains only complete records, so it can be appended
+    bool is_appendable_;
+};
+
+template <typename HandlerT>
+bool Index::parse(std::string const &key, HandlerT &handler) const
+{
+    auto entry = find(key);
+    if (!entry)
+        return false;
+    // only pages of the form are read
+    MappedFile src(path_, MADV_RANDOM);
+    if (entry->offset + entry->size > src.size())
+        throw cor::Error("Index of " + path_ + " is outdated");
+    auto begin = src.data() + entry->offset;
+    ParserImpl<char, HandlerT> impl(handler, entry->offset);
+    impl.feed(begin, begin + entry->size, true);
+    impl.end();
+    return true;
+}
+
+}}
+
+#endif // _COR_SEXP_INDEX_HPP_
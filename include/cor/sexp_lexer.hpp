@@ -0,0 +1,366 @@
+#ifndef _COR_SEXP_LEXER_HPP_
+#define _COR_SEXP_LEXER_HPP_
+
+#include <cor/sexp_impl.hpp>
+
+#include <vector>
+#include <iterator>
+
+namespace cor {
+namespace sexp {
+
+/**
+ * Pull lexer: tokens are read one by one by the caller, so it can be
+ * used to decode s-expressions directly into C++ structures by the
+ * hand-written recursive descent code:
+ *
+ *     sexp::Lexer lexer(data, size);
+ *     for (auto const &t : lexer) {
+ *         if (t.kind == sexp::Lexer::Atom)
+ *             use(t.value);
+ *     }
+ *
+ * Token value is a reference to the input if the token is not escaped
+ * and is not split between stream reads, otherwise to the lexer
+ * internal buffer. So it is valid only until the next token is read.
+ * Comments are skipped unless they are requested by set_comments()
+ */
+template <typename CharT>
+class BasicLexer
+{
+public:
+    typedef BasicStringRef<CharT> ref_type;
+
+    enum Kind {
+        ListBegin,
+        ListEnd,
+        Atom,
+        String,
+        Comment,
+        // end of the input
+        End
+    };
+
+    struct Token
+    {
+        Kind kind;
+        /// atom, string or comment text, empty for other tokens
+        ref_type value;
+        /// offset of the token start in the input
+        size_t pos;
+    };
+
+    class iterator;
+
+    /// read tokens from the buffer [src, src + len)
+    /// @param pos offset of the buffer in the whole input, token and
+    /// error positions are reported relative to the whole input
+    BasicLexer(CharT const *src, size_t len, size_t pos = 0)
+        : src_(nullptr), window_(src), p_(src), end_(src + len), base_(pos)
+    {
+        init();
+    }
+
+    BasicLexer(std::basic_string<CharT> const &src)
+        : src_(nullptr), window_(src.data()), p_(window_)
+        , end_(window_ + src.size()), base_(0)
+    {
+        init();
+    }
+
+    /// read tokens from the stream by blocks of buffer_size characters
+    BasicLexer(std::basic_istream<CharT> &src, size_t buffer_size = 64 * 1024)
+        : src_(&src), buf_(std::max<size_t>(buffer_size, 1))
+        , window_(buf_.data()), p_(window_), end_(window_), base_(0)
+    {
+        typename std::basic_istream<CharT>::sentry is_ready(src, true);
+        if (!is_ready) {
+            src_ = nullptr;
+        } else {
+            auto start = src.tellg();
+            base_ = start < 0 ? 0 : size_t(start);
+        }
+        init();
+    }
+
+    /// read the next token
+    /// @return current token, End at the end of input
+    Token const &next() { return read(true); }
+
+    Token const &token() const { return token_; }
+
+    /// skip the rest of the current list including its end. Called
+    /// after ListBegin it skips the whole list. Only the structure is
+    /// scanned, skipped tokens are not collected
+    void skip();
+
+    /// pass or skip comments, they are skipped by default
+    void set_comments(bool is_passed) { is_comments_ = is_passed; }
+
+    /// count of characters consumed
+    size_t position() const { return base_ + (p_ - window_); }
+
+    /// nesting level of lists
+    unsigned level() const { return level_; }
+
+    /// the first token is read if it is not read yet
+    iterator begin()
+    {
+        if (!is_started_)
+            next();
+        return iterator(this);
+    }
+
+    iterator end() { return iterator(); }
+
+private:
+    BasicLexer(BasicLexer const &);
+    BasicLexer & operator =(BasicLexer const &);
+
+    typedef std::basic_string<CharT> string_type;
+
+    void init()
+    {
+        scan_ = default_scanner<CharT>();
+        level_ = 0;
+        is_comments_ = false;
+        is_started_ = false;
+        token_.kind = End;
+        token_.pos = position();
+    }
+
+    template <typename ... Args>
+    void error(char const *info, Args ... args)
+    {
+        throw Error(position(), info, args...);
+    }
+
+    Token const &set(Kind kind, size_t pos, ref_type value = ref_type())
+    {
+        token_.kind = kind;
+        token_.value = value;
+        token_.pos = pos;
+        return token_;
+    }
+
+    /// read the next block from the stream
+    /// @return false if there is no more input
+    bool fill()
+    {
+        if (!src_)
+            return false;
+        base_ += end_ - window_;
+        auto len = src_->rdbuf()->sgetn(buf_.data(), buf_.size());
+        window_ = p_ = buf_.data();
+        end_ = p_ + (len > 0 ? len : 0);
+        if (len > 0)
+            return true;
+        src_->setstate(std::ios_base::eofbit | std::ios_base::failbit);
+        src_ = nullptr;
+        return false;
+    }
+
+    bool get(CharT &c)
+    {
+        if (p_ == end_ && !fill())
+            return false;
+        c = *p_++;
+        return true;
+    }
+
+    /// @return value of the hex digit or -1, digit is consumed
+    int get_hex()
+    {
+        if (p_ == end_ && !fill())
+            return -1;
+        int v = char2hex(*p_);
+        if (v >= 0)
+            ++p_;
+        return v;
+    }
+
+    /// escape character is already consumed
+    CharT unescaped()
+    {
+        CharT c;
+        if (!get(c))
+            error("Expected escaped symbol, got EOS");
+        if (c != 'x')
+            return unescape(c);
+        int high = get_hex();
+        if (high < 0)
+            error("Escaped hex is empty");
+        int low = get_hex();
+        return static_cast<CharT>(low < 0 ? high : (high << 4) | low);
+    }
+
+    /// @param is_used token value is collected, otherwise the value is
+    /// empty
+    Token const &read(bool is_used);
+    ref_type body(Kind kind, bool is_used);
+
+    std::basic_istream<CharT> *src_;
+    std::vector<CharT> buf_;
+    // input available now is [p_, end_), window_ is at base_ offset
+    CharT const *window_;
+    CharT const *p_;
+    CharT const *end_;
+    size_t base_;
+    Scanner<CharT> scan_;
+    string_type data_;
+    Token token_;
+    unsigned level_;
+    bool is_comments_;
+    bool is_started_;
+};
+
+/// input iterator reading tokens, iterators are equal if both of them
+/// are at the end
+template <typename CharT>
+class BasicLexer<CharT>::iterator
+{
+public:
+    typedef std::input_iterator_tag iterator_category;
+    typedef Token value_type;
+    typedef ptrdiff_t difference_type;
+    typedef Token const *pointer;
+    typedef Token const &reference;
+
+    iterator(BasicLexer *lexer = nullptr) : lexer_(lexer) {}
+
+    Token const &operator *() const { return lexer_->token(); }
+    Token const *operator ->() const { return &lexer_->token(); }
+
+    iterator &operator ++()
+    {
+        lexer_->next();
+        return *this;
+    }
+
+    bool operator ==(iterator const &other) const
+    {
+        return is_end() == other.is_end();
+    }
+    bool operator !=(iterator const &other) const { return !(*this == other); }
+
+private:
+    bool is_end() const { return !lexer_ || lexer_->token().kind == End; }
+
+    BasicLexer *lexer_;
+};
+
+template <typename CharT>
+typename BasicLexer<CharT>::Token const &BasicLexer<CharT>::read(bool is_used)
+{
+    is_started_ = true;
+    data_.clear();
+    while (true) {
+        if (p_ == end_ && !fill())
+            return set(End, position());
+        auto pos = position();
+        switch (char_class(*p_)) {
+        case char_space:
+        case char_newline:
+            ++p_;
+            continue;
+        case char_list_begin:
+            ++p_;
+            ++level_;
+            return set(ListBegin, pos);
+        case char_list_end:
+            if (!level_)
+                error("Unexpected ')'");
+            ++p_;
+            --level_;
+            return set(ListEnd, pos);
+        case char_comment: {
+            ++p_;
+            auto value = body(Comment, is_comments_ && is_used);
+            if (!is_comments_)
+                continue;
+            return set(Comment, pos, is_used ? value : ref_type());
+        }
+        case char_quote: {
+            ++p_;
+            auto value = body(String, is_used);
+            return set(String, pos, is_used ? value : ref_type());
+        }
+        default: {
+            auto value = body(Atom, is_used);
+            return set(Atom, pos, is_used ? value : ref_type());
+        }
+        }
+    }
+}
+
+/// the rest of the list is usually available in the buffer, it is
+/// scanned like by the Index. Otherwise (it is split between stream
+/// reads or it is not complete) tokens are read without collecting
+/// them
+template <typename CharT>
+void BasicLexer<CharT>::skip()
+{
+    if (!level_)
+        return;
+    ScannedItem<CharT> item;
+    if (scan_item(window_, p_, end_, item, 1, scan_)) {
+        p_ = item.end;
+        --level_;
+        set(ListEnd, position() - 1);
+        return;
+    }
+    auto level = level_;
+    while (level_ >= level && read(false).kind != End) {}
+}
+
+/// token body is scanned by runs of characters, terminating quote or
+/// newline is consumed, atom delimiter is not. Text is collected in
+/// data_ only if it is escaped or split between reads
+template <typename CharT>
+typename BasicLexer<CharT>::ref_type
+BasicLexer<CharT>::body(Kind kind, bool is_used)
+{
+    auto scan = (kind == Atom ? scan_.atom
+                 : (kind == String ? scan_.string : scan_.comment));
+    while (true) {
+        auto run = p_;
+        p_ = scan(p_, end_);
+        if (p_ == end_) {
+            if (data_.empty() && !src_) {
+                if (kind == String)
+                    error("string is not limited, got EOS");
+                return ref_type(run, p_ - run);
+            }
+            if (is_used)
+                data_.append(run, p_);
+            if (fill())
+                continue;
+            if (kind == String)
+                error("string is not limited, got EOS");
+            return ref_type(data_);
+        }
+        if (kind != Comment && char_class(*p_) == char_escape) {
+            if (is_used)
+                data_.append(run, p_);
+            ++p_;
+            auto c = unescaped();
+            if (is_used)
+                data_ += c;
+            continue;
+        }
+        auto token_end = p_;
+        if (kind != Atom)
+            ++p_;
+        if (data_.empty())
+            return ref_type(run, token_end - run);
+        if (is_used)
+            data_.append(run, token_end);
+        return ref_type(data_);
+    }
+}
+
+typedef BasicLexer<char> Lexer;
+
+}}
+
+#endif // _COR_SEXP_LEXER_HPP_
@@ -0,0 +1,595 @@
+#ifndef _COR_SEXP_LITERAL_HPP_
+#define _COR_SEXP_LITERAL_HPP_
+
+#include <cor/sexp_impl.hpp>
+
+#include <string>
+#include <type_traits>
+
+namespace cor {
+namespace sexp {
+
+/**
+ * Compile-time s-expression literals: text is validated and split into
+ * the static read-only table of nodes by the compiler, so the malformed
+ * literal breaks the build and there is no parsing at runtime.
+ *
+ *     COR_SEXP_LITERAL(DefaultConfig, "(device (:name \"X\" :mode 1))");
+ *
+ *     for (auto const &node : DefaultConfig())
+ *         if (node.kind == sexp::literal::Atom)
+ *             use(node.value());
+ *     DefaultConfig::parse(interpreter);
+ *
+ * The literal grammar is the same as the parser one, except that all
+ * lists should be closed. Comments are not included into the table.
+ *
+ * Text is split into halves processed by separate instantiations, see
+ * literal::Range, so the text is processed once, the recursion depth is
+ * logarithmic and does not hit compiler limits for literals of the size
+ * of the embedded configuration
+ */
+namespace literal {
+
+enum Kind {
+    ListBegin,
+    ListEnd,
+    Atom,
+    String,
+    // the last node of the table
+    End
+};
+
+struct Node
+{
+    constexpr Node(Kind kind = End, char const *data = nullptr,
+                   size_t size = 0, bool is_escaped = false)
+        : kind(kind), data(data), size(size), is_escaped(is_escaped)
+    {}
+
+    /// raw token text, escape sequences are not replaced if is_escaped
+    StringRef value() const { return StringRef(data, size); }
+
+    Kind kind;
+    char const *data;
+    size_t size;
+    bool is_escaped;
+};
+
+enum State {
+    Top,
+    InAtom,
+    InString,
+    InComment,
+    AtomEscape,
+    StringEscape,
+    AtomHex,
+    StringHex
+};
+
+enum Problem {
+    no_problem,
+    wrong_escape
+};
+
+/// summary of the text range processed from the known state
+struct Summary
+{
+    constexpr Summary(State state, Problem problem = no_problem,
+                      int depth = 0, int min_depth = 0, int max_depth = 0,
+                      size_t nodes = 0, bool has_top = false)
+        : state(state), problem(problem), depth(depth)
+        , min_depth(min_depth), max_depth(max_depth), nodes(nodes)
+        , has_top(has_top)
+    {}
+
+    // state after the range
+    State state;
+    Problem problem;
+    // list nesting level change, its minimum and maximum in the range
+    int depth;
+    int min_depth;
+    int max_depth;
+    // count of nodes starting in the range
+    size_t nodes;
+    // range has a character after which the state is Top
+    bool has_top;
+};
+
+static const size_t npos = size_t(-1);
+
+constexpr CharClass char_class_of(char c)
+{
+    return (c == ' ' || c == '\t' || c == '\v' || c == '\f' || c == '\r')
+        ? char_space
+        : c == '\n' ? char_newline
+        : c == '(' ? char_list_begin
+        : c == ')' ? char_list_end
+        : c == '"' ? char_quote
+        : c == ';' ? char_comment
+        : c == '\\' ? char_escape
+        : char_other;
+}
+
+constexpr bool is_hex(char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f')
+        || (c >= 'A' && c <= 'F');
+}
+
+/// summary of the single character starting a node
+constexpr Summary node_start(State state, int depth = 0)
+{
+    return Summary(state, no_problem, depth, depth < 0 ? depth : 0,
+                   depth > 0 ? depth : 0, 1, state == Top);
+}
+
+constexpr Summary step_top(CharClass cls)
+{
+    return cls == char_list_begin ? node_start(Top, 1)
+        : cls == char_list_end ? node_start(Top, -1)
+        : cls == char_quote ? node_start(InString)
+        : cls == char_comment ? Summary(InComment)
+        : cls == char_escape ? node_start(AtomEscape)
+        : cls == char_other ? node_start(InAtom)
+        : Summary(Top, no_problem, 0, 0, 0, 0, true);
+}
+
+constexpr Summary step_atom(CharClass cls)
+{
+    return cls == char_escape ? Summary(AtomEscape)
+        : (cls == char_other || cls == char_quote || cls == char_comment)
+        ? Summary(InAtom)
+        // delimiter is processed as in the Top state
+        : step_top(cls);
+}
+
+constexpr Summary step_hex(char c, State after)
+{
+    return is_hex(c) ? Summary(after) : Summary(after, wrong_escape);
+}
+
+/// the same transitions as ParserImpl::step() has
+constexpr Summary step(char c, State state)
+{
+    return state == Top ? step_top(char_class_of(c))
+        : state == InAtom ? step_atom(char_class_of(c))
+        : state == InString
+        ? (c == '"' ? Summary(Top, no_problem, 0, 0, 0, 0, true)
+           : c == '\\' ? Summary(StringEscape)
+           : Summary(InString))
+        : state == InComment
+        ? (c == '\n' ? Summary(Top, no_problem, 0, 0, 0, 0, true)
+           : Summary(InComment))
+        : state == AtomEscape ? Summary(c == 'x' ? AtomHex : InAtom)
+        : state == StringEscape ? Summary(c == 'x' ? StringHex : InString)
+        : state == AtomHex ? step_hex(c, InAtom)
+        : step_hex(c, InString);
+}
+
+constexpr int min_of(int a, int b) { return a < b ? a : b; }
+constexpr int max_of(int a, int b) { return a > b ? a : b; }
+
+constexpr Summary join(Summary const &l, Summary const &r)
+{
+    return Summary(r.state, l.problem ? l.problem : r.problem,
+                   l.depth + r.depth, min_of(l.min_depth, l.depth + r.min_depth),
+                   max_of(l.max_depth, l.depth + r.max_depth),
+                   l.nodes + r.nodes, l.has_top || r.has_top);
+}
+
+constexpr Summary summary(char const *text, size_t lo, size_t hi, State state);
+
+constexpr Summary join_right(char const *text, Summary const &l,
+                             size_t lo, size_t hi)
+{
+    return join(l, summary(text, lo, hi, l.state));
+}
+
+/// summary of the range [lo, hi) of the text processed from the state
+constexpr Summary summary(char const *text, size_t lo, size_t hi, State state)
+{
+    return lo == hi ? Summary(state)
+        : hi - lo == 1 ? step(text[lo], state)
+        : join_right(text, summary(text, lo, lo + (hi - lo) / 2, state),
+                     lo + (hi - lo) / 2, hi);
+}
+
+/// position of the character starting the node and the state before it
+struct NodeStart
+{
+    constexpr NodeStart(size_t pos, State state) : pos(pos), state(state) {}
+
+    size_t pos;
+    State state;
+};
+
+constexpr NodeStart find_node_in(char const *text, size_t pos, State state,
+                                 size_t n, Summary const &at);
+
+/// find the start of the n-th node scanning from pos
+constexpr NodeStart find_node(char const *text, size_t pos, State state,
+                              size_t n)
+{
+    return find_node_in(text, pos, state, n, step(text[pos], state));
+}
+
+constexpr NodeStart find_node_in(char const *text, size_t pos, State state,
+                                 size_t n, Summary const &at)
+{
+    return (at.nodes && !n) ? NodeStart(pos, state)
+        : find_node(text, pos + 1, at.state, n - at.nodes);
+}
+
+/// find the first position >= from in [pos, hi) after which the state
+/// is Top scanning from pos, npos if there is no such position
+constexpr size_t find_top(char const *text, size_t pos, size_t hi,
+                          State state, size_t from)
+{
+    return pos == hi ? npos
+        : (pos >= from && step(text[pos], state).has_top) ? pos
+        : find_top(text, pos + 1, hi, step(text[pos], state).state, from);
+}
+
+/// ranges up to this size are processed by the linear scan
+static const size_t leaf_size = 8;
+
+/**
+ * summary of the text range [Lo, Lo + Size) processed from the state
+ * S. Ranges are split in halves and each range is a separate
+ * instantiation, so the summary of each range is computed once: the
+ * whole text is processed in one pass with the logarithmic depth, and
+ * nodes are found by descending over already computed summaries
+ */
+template <typename SourceT, size_t Lo, size_t Size, State S,
+          bool = (Size <= leaf_size)>
+struct Range
+{
+    typedef SourceT source_type;
+    typedef Range<SourceT, Lo, Size / 2, S> left;
+    typedef Range<SourceT, Lo + Size / 2, Size - Size / 2,
+                  left::value.state> right;
+
+    static const bool is_leaf = false;
+    static const size_t lo = Lo;
+    static const size_t size = Size;
+    static constexpr State state = S;
+    static constexpr Summary value = join(left::value, right::value);
+};
+
+template <typename SourceT, size_t Lo, size_t Size, State S, bool L>
+constexpr Summary Range<SourceT, Lo, Size, S, L>::value;
+
+template <typename SourceT, size_t Lo, size_t Size, State S>
+struct Range<SourceT, Lo, Size, S, true>
+{
+    typedef SourceT source_type;
+
+    static const bool is_leaf = true;
+    static const size_t lo = Lo;
+    static const size_t size = Size;
+    static constexpr State state = S;
+    static constexpr Summary value
+    = summary(SourceT::data(), Lo, Lo + Size, S);
+};
+
+template <typename SourceT, size_t Lo, size_t Size, State S>
+constexpr Summary Range<SourceT, Lo, Size, S, true>::value;
+
+/// the N-th node start of the range
+template <typename RangeT, size_t N, bool = RangeT::is_leaf>
+struct FindNode
+{
+    static constexpr NodeStart value = find_node
+        (RangeT::source_type::data(), RangeT::lo, RangeT::state, N);
+};
+
+template <typename RangeT, size_t N, bool L>
+constexpr NodeStart FindNode<RangeT, N, L>::value;
+
+template <typename RangeT, size_t N>
+struct FindNode<RangeT, N, false>
+{
+    typedef typename RangeT::left left;
+    // only the chosen half is instantiated
+    static constexpr NodeStart value = std::conditional
+        <(N < left::value.nodes), FindNode<left, N>,
+         FindNode<typename RangeT::right, N - left::value.nodes>
+         >::type::value;
+};
+
+template <typename RangeT, size_t N>
+constexpr NodeStart FindNode<RangeT, N, false>::value;
+
+template <size_t V>
+struct Position
+{
+    static const size_t value = V;
+};
+
+/// the first position >= From in the range after which the state is
+/// Top, so the token started before is finished there, or npos
+template <typename RangeT, size_t From, bool = RangeT::is_leaf>
+struct FindTop
+{
+    static const size_t value = find_top
+        (RangeT::source_type::data(), RangeT::lo, RangeT::lo + RangeT::size,
+         RangeT::state, From);
+};
+
+template <typename RangeT, size_t From>
+struct SearchTop
+{
+    typedef FindTop<typename RangeT::left, From> in_left;
+    static const size_t value = std::conditional
+        <in_left::value != npos, Position<in_left::value>,
+         FindTop<typename RangeT::right, From> >::type::value;
+};
+
+template <typename RangeT, size_t From>
+struct FindTop<RangeT, From, false>
+{
+    // ranges w/o the position are not descended
+    static const bool is_skipped = (RangeT::lo + RangeT::size <= From)
+        || (RangeT::lo >= From && !RangeT::value.has_top);
+    static const size_t value = std::conditional
+        <is_skipped, Position<npos>, SearchTop<RangeT, From> >::type::value;
+};
+
+constexpr bool has_escape(char const *text, size_t lo, size_t hi)
+{
+    return lo == hi ? false
+        : hi - lo == 1 ? text[lo] == '\\'
+        : (has_escape(text, lo, lo + (hi - lo) / 2)
+           || has_escape(text, lo + (hi - lo) / 2, hi));
+}
+
+constexpr Node mk_token(Kind kind, char const *text, size_t begin, size_t end)
+{
+    return Node(kind, text + begin, end - begin, has_escape(text, begin, end));
+}
+
+constexpr size_t or_size(size_t pos, size_t size)
+{
+    return pos == npos ? size : pos;
+}
+
+/// N-th node of the valid literal
+template <typename RangeT, size_t N>
+struct NodeAt
+{
+    typedef FindNode<RangeT, N> start;
+    static const size_t pos = start::value.pos;
+    static const bool is_list = (RangeT::source_type::data()[pos] == '('
+                                 || RangeT::source_type::data()[pos] == ')');
+    // end of the token starting at pos, lists have no end
+    static const size_t end = or_size
+        (std::conditional<is_list, Position<npos>,
+         FindTop<RangeT, pos + 1> >::type::value, RangeT::size);
+
+    static constexpr Node node()
+    {
+        return text()[pos] == '(' ? Node(ListBegin)
+            : text()[pos] == ')' ? Node(ListEnd)
+            : (text()[pos] == '"' && start::value.state == Top)
+            ? mk_token(String, text(), pos + 1, end)
+            : mk_token(Atom, text(), pos, end);
+    }
+
+private:
+    static constexpr char const *text()
+    {
+        return RangeT::source_type::data();
+    }
+};
+
+template <size_t ... I>
+struct Indices {};
+
+template <typename A, typename B>
+struct JoinIndices;
+
+template <size_t ... A, size_t ... B>
+struct JoinIndices<Indices<A...>, Indices<B...> >
+{
+    typedef Indices<A..., (sizeof...(A) + B)...> type;
+};
+
+/// Indices<0, ..., N - 1>, generated with logarithmic instantiation depth
+template <size_t N>
+struct MakeIndices
+{
+    typedef typename JoinIndices
+    <typename MakeIndices<N / 2>::type,
+     typename MakeIndices<N - N / 2>::type>::type type;
+};
+
+template <>
+struct MakeIndices<0>
+{
+    typedef Indices<> type;
+};
+
+template <>
+struct MakeIndices<1>
+{
+    typedef Indices<0> type;
+};
+
+template <typename RangeT, typename IndicesT>
+struct Table;
+
+template <typename RangeT, size_t ... I>
+struct Table<RangeT, Indices<I...> >
+{
+    static constexpr Node nodes[sizeof...(I) + 1] = {
+        NodeAt<RangeT, I>::node()..., Node()
+    };
+};
+
+template <typename RangeT, size_t ... I>
+constexpr Node Table<RangeT, Indices<I...> >::nodes[sizeof...(I) + 1];
+
+/// replace escape sequences in the token the same way the parser does
+template <typename CharT>
+void unescape_token(BasicStringRef<CharT> const &src,
+                    std::basic_string<CharT> &dst)
+{
+    dst.clear();
+    auto p = src.data(), end = p + src.size();
+    while (p != end) {
+        auto c = *p++;
+        if (c != '\\' || p == end) {
+            dst.push_back(c);
+            continue;
+        }
+        c = *p++;
+        if (c != 'x') {
+            dst.push_back(unescape(c));
+            continue;
+        }
+        // the first hex digit is checked by the literal validation
+        int v = char2hex(*p++);
+        if (p != end && char2hex(*p) >= 0)
+            v = (v << 4) | char2hex(*p++);
+        dst.push_back(static_cast<CharT>(v));
+    }
+}
+
+} // literal
+
+/**
+ * s-expression literal, it should be defined by COR_SEXP_LITERAL().
+ * SourceT provides the text by constexpr static members data() and
+ * size()
+ */
+template <typename SourceT>
+class Literal
+{
+    typedef literal::Range<SourceT, 0, SourceT::size(), literal::Top>
+    range_type;
+
+    static constexpr literal::Summary summary()
+    {
+        return range_type::value;
+    }
+
+    static constexpr bool is_escape_finished()
+    {
+        return summary().problem == literal::no_problem
+            && summary().state != literal::AtomEscape
+            && summary().state != literal::StringEscape
+            && summary().state != literal::AtomHex
+            && summary().state != literal::StringHex;
+    }
+
+public:
+    typedef literal::Node const *iterator;
+
+    static_assert(summary().min_depth >= 0,
+                  "s-expression literal: unexpected ')'");
+    static_assert(is_escape_finished(),
+                  "s-expression literal: wrong escape sequence");
+    static_assert(summary().state != literal::InString
+                  && summary().state != literal::StringEscape
+                  && summary().state != literal::StringHex,
+                  "s-expression literal: string is not limited");
+    static_assert(summary().depth <= 0,
+                  "s-expression literal: list is not closed");
+
+    static constexpr bool is_valid()
+    {
+        return summary().min_depth >= 0 && summary().depth == 0
+            && is_escape_finished() && summary().state != literal::InString;
+    }
+
+    /// count of nodes
+    static constexpr size_t size()
+    {
+        return is_valid() ? summary().nodes : 0;
+    }
+
+    /// maximal nesting level of lists
+    static constexpr unsigned depth() { return summary().max_depth; }
+
+    static StringRef text()
+    {
+        return StringRef(SourceT::data(), SourceT::size());
+    }
+
+    static iterator begin() { return table_type::nodes; }
+    static iterator end() { return table_type::nodes + size(); }
+
+    /// pass nodes to the handler like the parser does, see
+    /// HandlerTraits, handler can skip lists
+    template <typename HandlerT>
+    static void parse(HandlerT &handler);
+
+private:
+    typedef literal::Table
+    <range_type, typename literal::MakeIndices<size()>::type> table_type;
+};
+
+template <typename SourceT>
+template <typename HandlerT>
+void Literal<SourceT>::parse(HandlerT &handler)
+{
+    typedef HandlerTraits<HandlerT> traits_type;
+    typedef typename traits_type::token_type token_type;
+
+    std::string unescaped;
+    // skip_level is the level of the list skipped by the handler
+    unsigned level = 0, skip_level = 0;
+    for (auto const &node : Literal()) {
+        if (node.kind == literal::ListEnd) {
+            if (!skip_level || skip_level == level) {
+                skip_level = 0;
+                handler.on_list_end();
+            }
+            --level;
+            continue;
+        }
+        if (node.kind == literal::ListBegin)
+            ++level;
+        if (skip_level)
+            continue;
+
+        bool is_skip = false;
+        auto value = node.value();
+        if (node.is_escaped) {
+            literal::unescape_token(value, unescaped);
+            value = StringRef(unescaped);
+        }
+        switch (node.kind) {
+        case literal::ListBegin:
+            is_skip = traits_type::list_begin(handler);
+            break;
+        case literal::Atom:
+            is_skip = traits_type::atom
+                (handler, token_type(value.data(), value.size()));
+            break;
+        default:
+            is_skip = traits_type::string
+                (handler, token_type(value.data(), value.size()));
+            break;
+        }
+        if (is_skip && level)
+            skip_level = level;
+    }
+    handler.on_eof();
+}
+
+}}
+
+/// define s-expression literal type name, see cor::sexp::Literal. The
+/// literal is validated by the compiler
+#define COR_SEXP_LITERAL(name, text)                                    \
+    struct name##_source                                                \
+    {                                                                   \
+        static constexpr char const *data() { return text; }            \
+        static constexpr size_t size() { return sizeof(text) - 1; }     \
+    };                                                                  \
+    typedef cor::sexp::Literal<name##_source> name;                     \
+    static_assert(sizeof(name) > 0, "s-expression literal")
+
+#endif // _COR_SEXP_LITERAL_HPP_
@@ -0,0 +1,218 @@
+#ifndef _COR_SEXP_PARALLEL_HPP_
+#define _COR_SEXP_PARALLEL_HPP_
+
+#include <cor/sexp_impl.hpp>
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <algorithm>
+
+namespace cor {
+namespace sexp {
+
+/// skip escape sequence started at p pointing to '\\'
+template <typename CharT>
+CharT const *skip_escaped(CharT const *p, CharT const *end)
+{
+    // hex digits of \x are ordinary characters for scanners
+    return (end - p > 1) ? p + 2 : end;
+}
+
+/**
+ * split input into chunks containing only whole top-level forms,
+ * strings, comments and escapes are taken into account. Input is not
+ * validated, errors are reported by the parser.
+ *
+ * Only structural characters are visited: quote and semicolon inside
+ * atom are ordinary characters, it is detected by the preceding one
+ *
+ * @param chunk_size minimal chunk size
+ * @param on_chunk is called with (begin, end) offsets of each chunk
+ */
+template <typename CharT, typename FnT>
+void split_forms
+(CharT const *src, size_t len, size_t chunk_size, FnT on_chunk)
+{
+    auto const &scan = default_scanner<CharT>();
+    CharT const *end = src + len, *chunk = src;
+    // top: parser is in the Top state here;
+    // escaped: the last escaped character, it is a part of an atom
+    CharT const *top = src, *escaped = nullptr;
+    unsigned level = 0;
+
+    auto is_atom = [&](CharT const *p) {
+        if (p == top)
+            return false;
+        if (p - 1 == escaped)
+            return true;
+        auto cls = char_class(p[-1]);
+        return !(cls == char_space || cls == char_newline
+                 || cls == char_list_begin || cls == char_list_end);
+    };
+
+    for (auto p = scan.structure(src, end); p != end;
+         p = scan.structure(p, end)) {
+        switch (char_class(*p)) {
+        case char_list_begin:
+            ++level;
+            top = ++p;
+            break;
+        case char_list_end:
+            if (level)
+                --level;
+            top = ++p;
+            if (!level && size_t(p - chunk) >= chunk_size && p != end) {
+                on_chunk(size_t(chunk - src), size_t(p - src));
+                chunk = p;
+            }
+            break;
+        case char_escape:
+            escaped = p + 1;
+            p = skip_escaped(p, end);
+            break;
+        case char_comment:
+            if (is_atom(p)) {
+                ++p;
+                break;
+            }
+            top = p = scan.comment(p, end);
+            break;
+        default: // quote
+            if (is_atom(p)) {
+                ++p;
+                break;
+            }
+            for (p = scan.string(p + 1, end); p != end;
+                 p = scan.string(p, end)) {
+                if (char_class(*p) == char_quote) {
+                    ++p;
+                    break;
+                }
+                p = skip_escaped(p, end);
+            }
+            top = p;
+            break;
+        }
+    }
+    on_chunk(size_t(chunk - src), len);
+}
+
+/// @return chunk boundaries: 0, end of the 1st chunk, ..., len
+template <typename CharT>
+std::vector<size_t> split_forms
+(CharT const *src, size_t len, size_t chunk_size)
+{
+    std::vector<size_t> res = {0};
+    split_forms(src, len, chunk_size, [&res](size_t, size_t end) {
+            res.push_back(end);
+        });
+    return res;
+}
+
+/**
+ * Parse top-level forms in parallel. Input is split into chunks of
+ * whole top-level forms by the calling thread, each chunk is parsed by
+ * own handler created by mk_handler() (also called from the calling
+ * thread). Worker threads start to parse chunks as soon as they are
+ * found. Each handler gets on_eof() at the end of the chunk
+ *
+ * @param mk_handler factory returning pointer (unique_ptr etc.) to handler
+ * @param threads count of threads used, 0 - use all available cores
+ * @param chunk_size minimal chunk size, 0 - chosen from input size
+ *
+ * @return handlers in the document order. If parsing of any chunk
+ * fails, the error from the first failed chunk is rethrown,
+ * sexp::Error::pos is an offset in the whole input
+ */
+template <typename CharT, typename FactoryT>
+auto parse_parallel(CharT const *src, size_t len, FactoryT mk_handler,
+                    unsigned threads = 0, size_t chunk_size = 0)
+    -> std::vector<decltype(mk_handler())>
+{
+    typedef decltype(mk_handler()) pointer_type;
+    typedef typename std::remove_reference
+        <decltype(*mk_handler())>::type handler_type;
+
+    if (!threads)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    if (!chunk_size)
+        chunk_size = std::max<size_t>(len / (threads * 8), 64 * 1024);
+
+    // all chunks except the last one are not less than chunk_size, so
+    // storage is allocated beforehand and is not reallocated later
+    size_t max_count = len / chunk_size + 1;
+    std::vector<pointer_type> handlers(max_count);
+    std::vector<size_t> bounds(max_count + 1);
+    std::vector<std::exception_ptr> errors(max_count);
+
+    // count and is_split are protected by mutex
+    size_t count = 0;
+    bool is_split = false;
+    std::mutex mutex;
+    std::condition_variable found;
+    std::atomic<size_t> next(0);
+
+    auto worker = [&]() {
+        while (true) {
+            size_t i = next++;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                found.wait(lock, [&]() { return i < count || is_split; });
+                if (i >= count)
+                    return;
+            }
+            try {
+                ParserImpl<CharT, handler_type> impl(*handlers[i], bounds[i]);
+                impl.feed(src + bounds[i], src + bounds[i + 1], true);
+                impl.end();
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        }
+    };
+
+    {
+        std::vector<std::thread> workers;
+        auto join = on_scope_exit([&]() {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    is_split = true;
+                }
+                found.notify_all();
+                for (auto &t : workers)
+                    t.join();
+            });
+        for (unsigned i = 1; i < threads; ++i)
+            workers.push_back(std::thread(worker));
+
+        split_forms(src, len, chunk_size, [&](size_t begin, size_t end) {
+                auto handler = mk_handler();
+                std::lock_guard<std::mutex> lock(mutex);
+                handlers[count] = std::move(handler);
+                bounds[count] = begin;
+                bounds[count + 1] = end;
+                ++count;
+                found.notify_one();
+            });
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            is_split = true;
+        }
+        found.notify_all();
+        worker();
+    }
+
+    handlers.resize(count);
+    for (auto &e : errors)
+        if (e)
+            std::rethrow_exception(e);
+    return handlers;
+}
+
+}}
+
+#endif // _COR_SEXP_PARALLEL_HPP_
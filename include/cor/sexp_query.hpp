@@ -0,0 +1,354 @@
+#ifndef _COR_SEXP_QUERY_HPP_
+#define _COR_SEXP_QUERY_HPP_
+
+#include <cor/sexp.hpp>
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace cor {
+namespace sexp {
+
+/**
+ * Compiled query path. Path is a sequence of steps separated by '/',
+ * each step matches one level of nested lists:
+ *
+ * - name - list starting from the atom name: (name ...)
+ * - * - list starting from any atom
+ * - ** - any count of nested lists (including zero)
+ *
+ * The last step can be followed by predicates [key=value]: matched
+ * list should contain atom key followed by the atom or string value as
+ * direct items (like a property list: only the first occurrence of the
+ * key is checked), e.g. "config/devices/device[:name=X]" matches
+ * (device :name X) and (device :type y :name "X") inside
+ * (config (devices ...)).
+ *
+ * Path is matched by the NFA: set of matched steps is a bitmask, so
+ * path can contain up to 63 steps
+ */
+class QueryPath
+{
+public:
+    typedef uint64_t set_type;
+
+    struct Predicate
+    {
+        std::string key;
+        std::string value;
+    };
+
+    QueryPath(std::string const &path);
+
+    /// set of matched steps at the top level
+    set_type start() const { return start_; }
+
+    /// steps matched by the list starting from the head, head is
+    /// nullptr if the list does not start from the atom
+    set_type advance(set_type from, StringRef const *head) const;
+
+    bool is_match(set_type s) const { return (s >> steps_.size()) & 1; }
+
+    std::vector<Predicate> const &predicates() const { return predicates_; }
+
+private:
+    enum StepKind {
+        Name,
+        AnyName,
+        AnyDepth
+    };
+
+    struct Step
+    {
+        StepKind kind;
+        std::string name;
+    };
+
+    /// steps after AnyDepth are also matched
+    set_type closure(set_type s) const;
+
+    std::vector<Step> steps_;
+    std::vector<Predicate> predicates_;
+    set_type start_;
+};
+
+/**
+ * Streaming query: handler passing only lists matched by the path (see
+ * QueryPath) to the next handler, the rest of input is skipped by the
+ * parser w/o tokenizing. Lists nested into the matched one are passed
+ * as is. Comments are not passed.
+ *
+ *     sexp::Writer out;
+ *     sexp::Query<sexp::Writer> query("config/devices/device", out);
+ *     sexp::parse(data, size, query);
+ *
+ * If path has predicates, matched list is accumulated in the query
+ * until its end and is passed to the next handler only if predicates
+ * are satisfied. The rest of the list is skipped as soon as any
+ * predicate fails
+ */
+template <typename NextT>
+class Query
+{
+    typedef HandlerTraits<NextT> next_traits;
+public:
+    typedef typename next_traits::token_type token_type;
+
+    Query(std::string const &path, NextT &next)
+        : path_(path), next_(next), mode_(Search), depth_(0), count_(0)
+        , expecting_(0), is_skipped_(false)
+    {
+        levels_.push_back(Level{path_.start(), false});
+    }
+
+    Action on_list_begin();
+    void on_list_end();
+    Action on_atom(token_type &&s) { return token(Atom, std::move(s)); }
+    Action on_string(token_type &&s) { return token(String, std::move(s)); }
+    void on_eof() { next_.on_eof(); }
+
+    /// count of lists passed to the next handler
+    size_t count() const { return count_; }
+
+private:
+    enum Mode {
+        Search,
+        // matched list is passed to the next handler
+        Pass,
+        // matched list is accumulated to check predicates
+        Accumulate
+    };
+
+    enum Kind {
+        ListBegin,
+        ListEnd,
+        Atom,
+        String
+    };
+
+    struct Level
+    {
+        QueryPath::set_type steps;
+        // list head is not seen yet
+        bool is_head_pending;
+    };
+
+    struct Event
+    {
+        Kind kind;
+        size_t pos;
+        size_t size;
+    };
+
+    static Action result(bool is_skip) { return is_skip ? skip_list : proceed; }
+
+    /// the first item of the list is got
+    Action head(Kind kind, StringRef const *value);
+
+    Action token(Kind kind, token_type &&s);
+
+    /// pass event to the next handler
+    /// @return true if the next handler requested to skip the list
+    bool pass(Kind kind, token_type &&s);
+
+    /// @return false if predicates are failed
+    bool accumulate(Kind kind, StringRef const &s);
+
+    /// matched list is complete
+    void finish();
+
+    QueryPath path_;
+    NextT &next_;
+    std::vector<Level> levels_;
+    Mode mode_;
+    // nesting level inside the matched list
+    unsigned depth_;
+    size_t count_;
+    // accumulated events
+    std::vector<Event> events_;
+    std::string arena_;
+    // predicates: satisfied ones and the one expecting value
+    std::vector<bool> is_satisfied_;
+    size_t expecting_;
+    // the rest of the matched list is skipped: the next handler asked
+    // for it or predicates are failed
+    bool is_skipped_;
+};
+
+template <typename NextT>
+Action Query<NextT>::on_list_begin()
+{
+    if (mode_ != Search) {
+        ++depth_;
+        return is_skipped_ ? skip_list : token(ListBegin, token_type());
+    }
+    auto is_skip = false;
+    if (levels_.back().is_head_pending)
+        is_skip = (head(ListBegin, nullptr) == skip_list);
+    if (mode_ != Search) {
+        // parent list w/o head is matched, the next handler can skip it
+        ++depth_;
+        is_skipped_ = is_skip;
+        return is_skip ? skip_list : token(ListBegin, token_type());
+    }
+    levels_.push_back(Level{levels_.back().steps, true});
+    return result(is_skip || !levels_.back().steps);
+}
+
+template <typename NextT>
+void Query<NextT>::on_list_end()
+{
+    if (mode_ == Search) {
+        levels_.pop_back();
+        return;
+    }
+    if (mode_ == Pass) {
+        // only the end of the skipped matched list is passed
+        if (!is_skipped_ || !depth_)
+            next_.on_list_end();
+    } else {
+        accumulate(ListEnd, StringRef());
+    }
+    if (depth_) {
+        --depth_;
+        return;
+    }
+    if (mode_ == Accumulate)
+        finish();
+    mode_ = Search;
+    levels_.pop_back();
+}
+
+template <typename NextT>
+Action Query<NextT>::head(Kind kind, StringRef const *value)
+{
+    auto &level = levels_.back();
+    auto &parent = levels_[levels_.size() - 2];
+    level.is_head_pending = false;
+    level.steps = path_.advance(parent.steps, kind == Atom ? value : nullptr);
+    if (path_.is_match(level.steps)) {
+        depth_ = 0;
+        is_skipped_ = false;
+        if (path_.predicates().empty()) {
+            mode_ = Pass;
+            ++count_;
+            return result(next_traits::list_begin(next_));
+        }
+        mode_ = Accumulate;
+        events_.clear();
+        arena_.clear();
+        is_satisfied_.assign(path_.predicates().size(), false);
+        expecting_ = is_satisfied_.size();
+        accumulate(ListBegin, StringRef());
+        return proceed;
+    }
+    return result(!level.steps);
+}
+
+template <typename NextT>
+Action Query<NextT>::token(Kind kind, token_type &&s)
+{
+    if (mode_ == Search) {
+        if (levels_.size() == 1)
+            return proceed;
+        if (levels_.back().is_head_pending) {
+            StringRef value(s.data(), s.size());
+            auto action = head(kind, &value);
+            if (mode_ == Search || action == skip_list)
+                return action;
+        } else {
+            // list can't contain matching lists
+            return result(!levels_.back().steps);
+        }
+    }
+    if (is_skipped_)
+        return skip_list;
+    if (mode_ == Pass)
+        return result(pass(kind, std::move(s)));
+    return result(!accumulate(kind, StringRef(s.data(), s.size())));
+}
+
+template <typename NextT>
+bool Query<NextT>::pass(Kind kind, token_type &&s)
+{
+    switch (kind) {
+    case ListBegin:
+        return next_traits::list_begin(next_);
+    case ListEnd:
+        next_.on_list_end();
+        return false;
+    case Atom:
+        return next_traits::atom(next_, std::move(s));
+    default:
+        return next_traits::string(next_, std::move(s));
+    }
+}
+
+template <typename NextT>
+bool Query<NextT>::accumulate(Kind kind, StringRef const &s)
+{
+    if (is_skipped_)
+        return false;
+    events_.push_back(Event{kind, arena_.size(), s.size()});
+    arena_.append(s.data(), s.size());
+    auto const &predicates = path_.predicates();
+    bool is_item = !depth_ && (kind == Atom || kind == String);
+    // direct item of the matched list or nested list beginning
+    if (!is_item && !(kind == ListBegin && depth_ == 1))
+        return true;
+    if (expecting_ < predicates.size()) {
+        // nested list is not a value, so the predicate is failed
+        if (!is_item || s != predicates[expecting_].value) {
+            is_skipped_ = true;
+            return false;
+        }
+        is_satisfied_[expecting_] = true;
+        expecting_ = predicates.size();
+        return true;
+    }
+    if (kind != Atom)
+        return true;
+    for (size_t i = 0; i < predicates.size(); ++i) {
+        if (!is_satisfied_[i] && s == predicates[i].key) {
+            expecting_ = i;
+            break;
+        }
+    }
+    return true;
+}
+
+template <typename NextT>
+void Query<NextT>::finish()
+{
+    if (is_skipped_)
+        return;
+    for (auto v : is_satisfied_)
+        if (!v)
+            return;
+    ++count_;
+    // lists skipped by the next handler are skipped in the accumulated
+    // events: skip_level is the level of such list
+    unsigned level = 0, skip_level = 0;
+    for (auto const &e : events_) {
+        if (e.kind == ListEnd) {
+            if (!skip_level || skip_level == level) {
+                skip_level = 0;
+                next_.on_list_end();
+            }
+            --level;
+            continue;
+        }
+        if (e.kind == ListBegin)
+            ++level;
+        if (skip_level)
+            continue;
+        auto is_skip = pass(e.kind, token_type(arena_.data() + e.pos, e.size));
+        if (is_skip)
+            skip_level = level;
+    }
+}
+
+}}
+
+#endif // _COR_SEXP_QUERY_HPP_
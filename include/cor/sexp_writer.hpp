@@ -0,0 +1,189 @@
+#ifndef _COR_SEXP_WRITER_HPP_
+#define _COR_SEXP_WRITER_HPP_
+
+#include <cor/sexp.hpp>
+
+#include <string>
+#include <type_traits>
+
+namespace cor {
+namespace sexp {
+
+/**
+ * Output buffer. If it is created for the file descriptor, data is
+ * written out in batches when buffer grows above batch_size and on
+ * flush(), otherwise output is available through data() or str()
+ */
+class OutputBuffer
+{
+public:
+    OutputBuffer();
+    OutputBuffer(int fd, size_t batch_size);
+    ~OutputBuffer();
+
+    /// @return pointer to the space for at least len characters
+    char *reserve(size_t len)
+    {
+        auto need = size_ + len;
+        if (need > buf_.size())
+            grow(need);
+        return &buf_[size_];
+    }
+
+    /// data is written by the pointer got from reserve() till end
+    void commit(char *end)
+    {
+        size_ = end - buf_.data();
+        if (fd_ >= 0 && size_ >= batch_size_)
+            flush();
+    }
+
+    /// write out buffered data if buffer is created for the descriptor
+    void flush();
+
+    StringRef data() const { return StringRef(buf_.data(), size_); }
+    std::string str() const { return std::string(buf_.data(), size_); }
+
+private:
+    OutputBuffer(OutputBuffer const &);
+    OutputBuffer & operator =(OutputBuffer const &);
+
+    void grow(size_t size);
+
+    int fd_;
+    size_t batch_size_;
+    std::string buf_;
+    size_t size_;
+};
+
+/**
+ * Handler serializing s-expressions back to the text. Strings and
+ * atoms are escaped, so output is parsed to the same tokens: only
+ * quote and backslash are escaped in strings, atom characters are
+ * escaped if they are separators or special ones. Each top-level form
+ * is written on the separate line.
+ *
+ * Strings are received from the parser by chunks, so huge strings are
+ * not accumulated by the parser.
+ *
+ * Output is accumulated in the OutputBuffer, it is flushed on on_eof()
+ */
+class Writer
+{
+public:
+    typedef StringRef token_type;
+
+    Writer();
+    Writer(int fd, size_t batch_size = 64 * 1024);
+
+    void on_list_begin();
+    void on_list_end();
+    void on_comment(StringRef &&s);
+    void on_string(StringRef &&s);
+    void on_string_chunk(StringRef &&s);
+    void on_string_end();
+    void on_atom(StringRef &&s);
+    void on_eof();
+
+    void flush() { out_.flush(); }
+
+    StringRef data() const { return out_.data(); }
+    std::string str() const { return out_.str(); }
+
+private:
+    Writer(Writer const &);
+    Writer & operator =(Writer const &);
+
+    /// get space for len characters and the separator, separator is
+    /// written if needed
+    char *reserve(size_t len);
+    /// data is written till end
+    void written(char *end, bool need_space);
+
+    OutputBuffer out_;
+    unsigned level_;
+    bool need_space_;
+    // string chunk is written, closing quote is expected
+    bool is_string_;
+};
+
+/**
+ * Filter stage passing all events to the next handler. Filter is
+ * derived from it hiding methods it is interested in:
+ *
+ *     struct NoComments : public sexp::Filter<sexp::Writer> {
+ *         NoComments(sexp::Writer &w) : Filter(w) {}
+ *         void on_comment(token_type &&) {}
+ *     };
+ *
+ * Tokens are passed as StringRef if the next handler accepts them.
+ * Filter has callbacks only for tokens the next handler accepts, so
+ * the parser skips other tokens w/o collecting them. Requests to skip
+ * lists are passed back to the parser. If the next handler
+ * accepts strings by chunks, filter gets them by chunks of the same
+ * size too, so a filter changing strings should hide on_string_chunk()
+ * and on_string_end() instead of on_string()
+ */
+template <typename NextT>
+class Filter
+{
+    typedef HandlerTraits<NextT> next_traits;
+public:
+    typedef typename next_traits::token_type token_type;
+    static const size_t string_chunk_size = next_traits::string_chunk_size;
+
+    Filter(NextT &next) : next_(next) {}
+
+    Action on_list_begin()
+    {
+        return result(next_traits::list_begin(next_));
+    }
+    void on_list_end() { next_.on_list_end(); }
+
+    // token callbacks are declared only if the next handler accepts
+    // such tokens, see HandlerTraits
+    template <typename T = NextT>
+    typename std::enable_if<HandlerTraits<T>::has_comments, Action>::type
+    on_comment(token_type &&s)
+    {
+        return result(next_traits::comment(next_, std::move(s)));
+    }
+    template <typename T = NextT>
+    typename std::enable_if<(HandlerTraits<T>::has_strings
+                             || HandlerTraits<T>::has_string_chunks),
+                            Action>::type
+    on_string(token_type &&s)
+    {
+        return result(next_traits::string(next_, std::move(s)));
+    }
+    template <typename T = NextT>
+    typename std::enable_if<HandlerTraits<T>::has_string_chunks>::type
+    on_string_chunk(token_type &&s)
+    {
+        next_traits::string_chunk(next_, s.data(), s.size());
+    }
+    template <typename T = NextT>
+    typename std::enable_if<HandlerTraits<T>::has_string_chunks, Action>::type
+    on_string_end()
+    {
+        return result(next_traits::string_end(next_));
+    }
+    template <typename T = NextT>
+    typename std::enable_if<(HandlerTraits<T>::has_atoms
+                             || HandlerTraits<T>::has_typed_atoms),
+                            Action>::type
+    on_atom(token_type &&s)
+    {
+        return result(next_traits::atom(next_, std::move(s)));
+    }
+    void on_eof() { next_.on_eof(); }
+
+protected:
+    static Action result(bool is_skip) { return is_skip ? skip_list : proceed; }
+
+    NextT &next_;
+};
+
+}}
+
+#endif // _COR_SEXP_WRITER_HPP_
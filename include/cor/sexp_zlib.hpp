@@ -0,0 +1,112 @@
+#ifndef _COR_SEXP_ZLIB_HPP_
+#define _COR_SEXP_ZLIB_HPP_
+
+#include <cor/sexp_impl.hpp>
+#include <cor/pipe.hpp>
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+namespace cor {
+namespace sexp {
+
+/**
+ * Source of the decompressed data: input is read and decompressed by
+ * the separate thread into the bounded queue of blocks, so memory
+ * usage does not depend on the input size and decompression runs in
+ * parallel with parsing.
+ *
+ * Input format is detected by the header: gzip data is decompressed
+ * (concatenated gzip members are supported), other data is passed as
+ * is. zstd is not supported, it is reported as an error.
+ * Errors of reading and decompression are rethrown by next()
+ *
+ * The source can be destroyed before the end of the input (e.g. if the
+ * parser throws) for any descriptor including pipes: the worker waiting
+ * for the input is woken up by the internal pipe
+ */
+class CompressedSource
+{
+public:
+    /// @param fd input descriptor, it is not closed by the source
+    /// @param block_size size of decompressed blocks
+    /// @param blocks count of blocks in the queue
+    CompressedSource(int fd, size_t block_size = 256 * 1024,
+                     size_t blocks = 4);
+    CompressedSource(std::string const &path, size_t block_size = 256 * 1024,
+                     size_t blocks = 4);
+    ~CompressedSource();
+
+    /// get the next block, the previous one is released and should not
+    /// be used anymore
+    /// @return false if there is no more data
+    bool next(StringRef &block);
+
+private:
+    CompressedSource(CompressedSource const &);
+    CompressedSource & operator =(CompressedSource const &);
+
+    void start(size_t blocks);
+    void stop();
+    /// worker thread: reads, decompresses and publishes blocks
+    void produce();
+    /// @return free block or nullptr if source is stopped
+    std::string *acquire();
+    void publish(size_t size);
+
+    FdHandle file_;
+    int fd_;
+    size_t block_size_;
+    // ring of blocks: count_ blocks from head_ are filled, sizes_ are
+    // their data sizes
+    std::vector<std::string> blocks_;
+    std::vector<size_t> sizes_;
+    size_t head_;
+    size_t count_;
+    // consumer holds the head block
+    bool is_held_;
+    bool is_done_;
+    bool is_stopped_;
+    std::exception_ptr error_;
+    std::mutex mutex_;
+    std::condition_variable filled_;
+    std::condition_variable released_;
+    // written by stop() to interrupt waiting for the input
+    Pipe wake_;
+    std::thread worker_;
+};
+
+/// parse compressed (or plain) s-expressions from the descriptor
+/// w/o an intermediate file, see CompressedSource.
+/// sexp::Error::pos is an offset in the decompressed data
+template <typename HandlerT>
+void parse_compressed(CompressedSource &src, HandlerT &handler)
+{
+    ParserImpl<char, HandlerT> impl(handler);
+    StringRef block;
+    while (src.next(block))
+        impl.feed(block.data(), block.data() + block.size());
+    impl.end();
+}
+
+template <typename HandlerT>
+void parse_compressed(int fd, HandlerT &handler)
+{
+    CompressedSource src(fd);
+    parse_compressed(src, handler);
+}
+
+template <typename HandlerT>
+void parse_compressed(std::string const &path, HandlerT &handler)
+{
+    CompressedSource src(path);
+    parse_compressed(src, handler);
+}
+
+}}
+
+#endif // _COR_SEXP_ZLIB_HPP_
@@ -6,6 +6,8 @@
 #include <unistd.h>
 
 #include <vector>
+#include <string>
+#include <functional>
 #include <cstdio>
 #include <cstdarg>
 #include <stack>
@@ -71,6 +73,102 @@ private:
     std::time_t begin;
 };
 
+/// reference to the constant characters range. It does not own data,
+/// so referenced data should outlive the reference
+template <typename CharT>
+class BasicStringRef
+{
+public:
+    typedef CharT value_type;
+    typedef CharT const* const_iterator;
+    typedef std::basic_string<CharT> string_type;
+
+    BasicStringRef() : data_(nullptr), size_(0) {}
+    BasicStringRef(CharT const *data, size_t size)
+        : data_(data), size_(size) {}
+    BasicStringRef(CharT const *data)
+        : data_(data), size_(std::char_traits<CharT>::length(data)) {}
+    BasicStringRef(string_type const &src)
+        : data_(src.data()), size_(src.size()) {}
+
+    CharT const *data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return !size_; }
+
+    const_iterator begin() const { return data_; }
+    const_iterator end() const { return data_ + size_; }
+
+    CharT operator [](size_t pos) const { return data_[pos]; }
+
+    string_type str() const { return string_type(data_, size_); }
+
+    int compare(BasicStringRef const &other) const
+    {
+        auto len = std::min(size_, other.size_);
+        int rc = std::char_traits<CharT>::compare(data_, other.data_, len);
+        if (rc)
+            return rc;
+        return (size_ < other.size_) ? -1 : (size_ > other.size_ ? 1 : 0);
+    }
+
+private:
+    CharT const *data_;
+    size_t size_;
+};
+
+typedef BasicStringRef<char> StringRef;
+
+template <typename CharT>
+bool operator ==(BasicStringRef<CharT> const &a, BasicStringRef<CharT> const &b)
+{
+    return a.size() == b.size() && !a.compare(b);
+}
+
+template <typename CharT>
+bool operator ==
+(BasicStringRef<CharT> const &a, std::basic_string<CharT> const &b)
+{
+    return a == BasicStringRef<CharT>(b);
+}
+
+template <typename CharT>
+bool operator ==
+(std::basic_string<CharT> const &a, BasicStringRef<CharT> const &b)
+{
+    return BasicStringRef<CharT>(a) == b;
+}
+
+template <typename CharT>
+bool operator ==(BasicStringRef<CharT> const &a, CharT const *b)
+{
+    return a == BasicStringRef<CharT>(b);
+}
+
+template <typename CharT>
+bool operator ==(CharT const *a, BasicStringRef<CharT> const &b)
+{
+    return BasicStringRef<CharT>(a) == b;
+}
+
+template <typename CharT, typename T>
+bool operator !=(BasicStringRef<CharT> const &a, T const &b)
+{
+    return !(a == b);
+}
+
+template <typename CharT>
+bool operator <(BasicStringRef<CharT> const &a, BasicStringRef<CharT> const &b)
+{
+    return a.compare(b) < 0;
+}
+
+template <typename CharT>
+std::basic_ostream<CharT> & operator <<
+(std::basic_ostream<CharT> &dst, BasicStringRef<CharT> const &src)
+{
+    return dst.write(src.data(), src.size());
+}
+
 // adding .clear() to std::stack instantiated /w deque
 template <typename T>
 class stack : public std::stack<T, std::deque<T> >
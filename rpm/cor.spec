@@ -1,4 +1,5 @@
 %{!?_with_udev: %{!?_without_udev: %define _with_udev --with-udev}}
+%{!?_with_zlib: %{!?_without_zlib: %define _with_zlib --with-zlib}}
 
 Summary: Just another C++/C library
 Name: cor
@@ -14,6 +15,9 @@ BuildRequires: pkgconfig(tut) >= 0.0.1
 BuildRequires: pkgconfig(libudev) >= 187
 BuildRequires: pkgconfig(udev) >= 187
 %endif
+%if 0%{?_with_zlib:1}
+BuildRequires: pkgconfig(zlib)
+%endif
 Requires(post): /sbin/ldconfig
 Requires(postun): /sbin/ldconfig
 
@@ -33,7 +37,7 @@ cor library header files etc.
 %setup -q
 
 %build
-%cmake -DVERSION=%{version} %{?_with_multiarch:-DENABLE_MULTIARCH=ON} %{?_without_udev:-DENABLE_UDEV=OFF}
+%cmake -DVERSION=%{version} %{?_with_multiarch:-DENABLE_MULTIARCH=ON} %{?_without_udev:-DENABLE_UDEV=OFF} %{?_without_zlib:-DENABLE_ZLIB=OFF}
 make %{?jobs:-j%jobs}
 
 %check
@@ -58,6 +62,11 @@ rm -rf $RPM_BUILD_ROOT
 %{_libdir}/libcor-udev.so.0
 %{_libdir}/libcor-udev.so.%{version}
 %endif
+%if 0%{?_with_zlib:1}
+%{_libdir}/libcor-zlib.so
+%{_libdir}/libcor-zlib.so.0
+%{_libdir}/libcor-zlib.so.%{version}
+%endif
 
 %files devel
 %defattr(-,root,root,-)
@@ -1,12 +1,24 @@
 #include <cor/notlisp.hpp>
 #include <cor/sexp_impl.hpp>
 
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <sstream>
+
 namespace cor {
 namespace sexp {
 
 template
 void parse(std::basic_istream<char> &, cor::notlisp::Interpreter &);
 
+template
+void parse(char const *, size_t, cor::notlisp::Interpreter &);
+
+template
+void parse_file(std::string const &, cor::notlisp::Interpreter &);
+
 }}
 
 namespace cor
@@ -14,6 +26,195 @@ namespace cor
 namespace notlisp
 {
 
+namespace {
+
+/// interned name, never moved or removed
+struct Symbol
+{
+    std::string name;
+    uint64_t hash;
+    symbol_id id;
+};
+
+/**
+ * Open addressing index of symbols read w/o locking. Slots are only
+ * filled, never changed, so readers see either nullptr or the complete
+ * symbol. When the index is full the writer publishes the larger copy,
+ * the old one is kept because readers can still use it
+ */
+class SymbolIndex
+{
+public:
+    explicit SymbolIndex(size_t size)
+        : mask_(size - 1)
+        , slots_(new std::atomic<Symbol const*>[size]())
+        , symbols_(new Symbol const*[size / 2])
+        , count_(0)
+    {}
+
+    /// max count of symbols, the load factor is kept below 1/2
+    size_t capacity() const { return (mask_ + 1) / 2; }
+
+    /// called by the only writer
+    void add(Symbol const *sym)
+    {
+        auto pos = sym->hash & mask_;
+        while (slots_[pos].load(std::memory_order_relaxed))
+            pos = (pos + 1) & mask_;
+        symbols_[sym->id] = sym;
+        slots_[pos].store(sym, std::memory_order_release);
+        count_.store(sym->id + 1, std::memory_order_release);
+    }
+
+    symbol_id find(StringRef const &name, uint64_t hash) const
+    {
+        for (auto pos = hash & mask_; ; pos = (pos + 1) & mask_) {
+            auto sym = slots_[pos].load(std::memory_order_acquire);
+            if (!sym)
+                return no_symbol;
+            if (sym->hash == hash && StringRef(sym->name) == name)
+                return sym->id;
+        }
+    }
+
+    Symbol const *symbol(symbol_id id) const
+    {
+        return id < count_.load(std::memory_order_acquire)
+            ? symbols_[id] : nullptr;
+    }
+
+private:
+    size_t mask_;
+    std::unique_ptr<std::atomic<Symbol const*>[]> slots_;
+    std::unique_ptr<Symbol const*[]> symbols_;
+    std::atomic<size_t> count_;
+};
+
+/// symbols are interned under the lock, lookups do not lock
+class SymbolTable
+{
+public:
+    SymbolTable()
+    {
+        indices_.emplace_back(new SymbolIndex(256));
+        index_.store(indices_.back().get());
+    }
+
+    symbol_id intern(StringRef const &name)
+    {
+        auto hash = hash_bytes(name.data(), name.size());
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto index = indices_.back().get();
+        auto id = index->find(name, hash);
+        if (id != no_symbol)
+            return id;
+        if (symbols_.size() >= no_symbol)
+            throw Error("Symbol table is full");
+        id = symbols_.size();
+        // deque does not move its items, so indices refer to them
+        symbols_.push_back(Symbol{name.str(), hash, id});
+        if (symbols_.size() > index->capacity())
+            index = grow(*index);
+        index->add(&symbols_.back());
+        return id;
+    }
+
+    symbol_id find(StringRef const &name) const
+    {
+        return index_.load(std::memory_order_acquire)
+            ->find(name, hash_bytes(name.data(), name.size()));
+    }
+
+    std::string const &name(symbol_id id) const
+    {
+        auto sym = index_.load(std::memory_order_acquire)->symbol(id);
+        if (!sym)
+            throw Error("Unknown symbol id %u", id);
+        return sym->name;
+    }
+
+private:
+    /// new index with all symbols except the last one
+    SymbolIndex *grow(SymbolIndex const &from)
+    {
+        std::unique_ptr<SymbolIndex> res
+            (new SymbolIndex(from.capacity() * 4));
+        for (size_t i = 0; i + 1 < symbols_.size(); ++i)
+            res->add(&symbols_[i]);
+        indices_.push_back(std::move(res));
+        index_.store(indices_.back().get(), std::memory_order_release);
+        return indices_.back().get();
+    }
+
+    std::mutex mutex_;
+    std::deque<Symbol> symbols_;
+    // previous indices are never released, they take less memory
+    // than the current one
+    std::vector<std::unique_ptr<SymbolIndex> > indices_;
+    std::atomic<SymbolIndex const*> index_;
+};
+
+SymbolTable &symbols()
+{
+    static SymbolTable table;
+    return table;
+}
+
+}
+
+symbol_id intern(StringRef const &name)
+{
+    return symbols().intern(name);
+}
+
+symbol_id find_symbol(StringRef const &name)
+{
+    return symbols().find(name);
+}
+
+std::string const &symbol_name(symbol_id id)
+{
+    return symbols().name(id);
+}
+
+namespace {
+
+__thread bool is_local_refs_scope = false;
+
+}
+
+LocalRefs::LocalRefs()
+    : is_outer_local_(is_local_refs_scope)
+{
+    is_local_refs_scope = true;
+}
+
+LocalRefs::~LocalRefs()
+{
+    is_local_refs_scope = is_outer_local_;
+}
+
+bool is_local_refs()
+{
+    return is_local_refs_scope;
+}
+
+Env::Env(std::initializer_list<item_type> syms)
+{
+    slots_.reserve(syms.size());
+    for (auto const &item : syms)
+        slots_.insert(intern(item.first), item.second);
+}
+
+void Env::set(symbol_id id, expr_ptr value)
+{
+    if (id == no_symbol)
+        throw Error("Binding of the wrong symbol id");
+    auto res = slots_.insert(id, value);
+    if (!res.second)
+        *res.first = std::move(value);
+}
+
 expr_ptr mk_string(std::string const &s)
 {
     return mk_basic_expr<Expr::String>(s);
@@ -26,7 +227,13 @@ expr_ptr mk_keyword(std::string const &s)
 
 expr_ptr mk_nil()
 {
-    return expr_ptr(new BasicExpr<Expr::Nil>());
+    // nil has no state, so the single object is shared
+    static expr_ptr const nil = []() {
+        expr_ptr res(new BasicExpr<Expr::Nil>());
+        res->set_atomic_refs();
+        return res;
+    }();
+    return nil;
 }
 
 expr_ptr mk_symbol(std::string const &s)
@@ -39,11 +246,44 @@ expr_ptr mk_lambda(std::string const &name, lambda_type const &fn)
     return expr_ptr(new LambdaExpr(name, fn));
 }
 
+expr_ptr mk_value_lambda(std::string const &name,
+                         value_lambda_type const &fn)
+{
+    return expr_ptr(new ValueLambdaExpr(name, fn));
+}
+
 expr_ptr eval(env_ptr env, expr_ptr src)
 {
     return src ? src->do_eval(env, src) : mk_nil();
 }
 
+Value eval(env_ptr env, Value const &src)
+{
+    switch (src.kind()) {
+    case Value::Empty:
+        return Value::nil();
+    case Value::Ref: {
+        auto p = src.expr();
+        return p->do_eval(env, expr_ptr(p));
+    }
+    default:
+        // immediates are evaluated to themselves
+        return src;
+    }
+}
+
+expr_ptr Value::to_expr() const
+{
+    switch (kind_) {
+    case Nil: return mk_nil();
+    case Boolean: return mk_boolean(data_.b);
+    case Integer: return mk_value(data_.i);
+    case Real: return mk_value(data_.r);
+    case Ref: return expr_ptr(data_.p);
+    default: return expr_ptr();
+    }
+}
+
 static void must_have_type(expr_ptr expr, Expr::Type t,
                            std::string const &failure_msg)
 {
@@ -73,6 +313,62 @@ void to_double(expr_ptr expr, double &dst)
     dst = (double)*expr;
 }
 
+void to_bool(expr_ptr expr, bool &dst)
+{
+    must_have_type(expr, Expr::Boolean, "to_bool");
+    dst = (long)*expr;
+}
+
+// mismatched values are boxed to report the error the same way
+
+void to_string(Value const &v, std::string &dst)
+{
+    to_string(v.to_expr(), dst);
+}
+
+void to_long(Value const &v, long &dst)
+{
+    if (v.kind() == Value::Integer)
+        dst = v.as_long();
+    else
+        to_long(v.to_expr(), dst);
+}
+
+void to_double(Value const &v, double &dst)
+{
+    if (v.kind() == Value::Real)
+        dst = v.as_double();
+    else
+        to_double(v.to_expr(), dst);
+}
+
+void to_bool(Value const &v, bool &dst)
+{
+    if (v.kind() == Value::Boolean)
+        dst = v.as_bool();
+    else
+        to_bool(v.to_expr(), dst);
+}
+
+Value FunctionExpr::call(env_ptr env, value_list_type &params)
+{
+    expr_list_type boxed;
+    for (auto const &v : params)
+        boxed.push_back(v.to_expr());
+    return (*this)(env, std::move(boxed));
+}
+
+expr_ptr ValueLambdaExpr::operator ()(env_ptr env, expr_list_type &&params)
+{
+    value_list_type values(params.begin(), params.end());
+    return fn(env, values).to_expr();
+}
+
+expr_ptr ValueLambdaExpr::do_eval(env_ptr, expr_ptr self)
+{
+    return self;
+}
+
 expr_ptr LambdaExpr::do_eval(env_ptr, expr_ptr self)
 {
     return self;
@@ -85,7 +381,9 @@ expr_ptr PodExpr::do_eval(env_ptr, expr_ptr self)
 
 expr_ptr SymbolExpr::do_eval(env_ptr env, expr_ptr)
 {
-    return env->dict[value()];
+    if (id_ == no_symbol)
+        id_ = find_symbol(value());
+    return env->get(id_);
 }
 
 expr_ptr ObjectExpr::do_eval(env_ptr, expr_ptr self)
@@ -95,70 +393,108 @@ expr_ptr ObjectExpr::do_eval(env_ptr, expr_ptr self)
 
 expr_ptr default_atom_convert(std::string &&s)
 {
-    expr_ptr res(mk_nil());
-    if (s.size() && s[0] == ':')
-        res = mk_keyword(s.substr(1));
-    else {
-        double f;
-        long i;
-        auto convert = [&](char const *cstr, size_t len) {
-            char * endptr = nullptr;
-            char const* end = cstr + len;
-
-            i = std::strtol(cstr, &endptr, 10);
-            if (endptr == end)
-                return mk_value(i);
-
-            f = std::strtod(cstr, &endptr);
-            if (endptr == end)
-                return mk_value(f);
-
-            return mk_symbol(s);
-        };
-        res = convert(s.c_str(), s.size());
+    long i;
+    double r;
+    switch (sexp::classify_atom(s.data(), s.data() + s.size(), i, r)) {
+    case sexp::integer_atom:
+        return mk_value(i);
+    case sexp::real_atom:
+        return mk_value(r);
+    case sexp::keyword_atom:
+        return mk_keyword(s.substr(1));
+    default:
+        return mk_symbol(s);
     }
-    return res;
 }
 
 Interpreter::Interpreter(env_ptr env, atom_converter_type atom_converter)
     : env(env),
-      stack({expr_list_type()}),
+      frames_({0}),
+      is_finished_(false),
       convert_atom(atom_converter)
 {
+    typedef expr_ptr (*convert_type)(std::string &&);
+    auto fn = convert_atom.target<convert_type>();
+    is_default_convert = (fn && *fn == &default_atom_convert);
 }
 
-void Interpreter::on_atom(std::string &&s)
+void Interpreter::on_atom(StringRef &&s)
 {
-    auto v = convert_atom(std::move(s));
-    stack.top().push_back(eval(env, v));
+    is_finished_ = false;
+    if (!is_default_convert) {
+        values_.push_back(eval(env, convert_atom(s.str())));
+        return;
+    }
+    long i;
+    double r;
+    auto begin = s.data(), end = begin + s.size();
+    switch (sexp::classify_atom(begin, end, i, r)) {
+    case sexp::integer_atom:
+        values_.push_back(i);
+        break;
+    case sexp::real_atom:
+        values_.push_back(r);
+        break;
+    case sexp::keyword_atom:
+        values_.push_back(mk_keyword(std::string(begin + 1, end)));
+        break;
+    default:
+        // symbol is evaluated to its binding, so it is not created
+        values_.push_back(env->get(s));
+        break;
+    }
 }
 
 void Interpreter::on_list_end()
 {
-    auto &t = stack.top();
+    auto begin = frames_.back();
 
-    if (t.empty())
+    if (begin == values_.size())
         throw Error("Evaluation of empty expression");
 
-    auto &expr = *t.begin();
+    auto const &expr = values_[begin];
     auto p = eval(env, expr);
-    if (!p)
+    if (!p) {
+        std::stringstream ss;
+        ss << expr;
         throw Error("Got null evaluating %s, expecting function",
-                         expr->value().c_str());
+                    ss.str().c_str());
+    }
 
-    if (p->type() != Expr::Function)
-        throw Error("Not a function, type %d", p->type());
-    t.pop_front();
-    expr_ptr res;
+    if (p.type() != Expr::Function)
+        throw Error("Not a function, type %d", p.type());
+    auto &fn = static_cast<FunctionExpr&>(*p.expr());
+    // parameters storage is reused, functions should not keep it
+    params_.clear();
+    for (auto i = begin + 1; i < values_.size(); ++i)
+        params_.push_back(eval(env, values_[i]));
+    Value res;
     try {
-        res = static_cast<FunctionExpr&>(*p)(env, eval(env, t));
+        res = fn.call(env, params_);
     } catch (cor::Error const &e) {
         std::cerr << "Error '" << e.what() << "' evaluating "
-                  << *p << std::endl;
+                  << fn << std::endl;
         throw e;
     }
-    stack.pop();
-    stack.top().push_back(res);
+    params_.clear();
+    values_.erase(values_.begin() + begin, values_.end());
+    frames_.pop_back();
+    values_.push_back(std::move(res));
+}
+
+void Interpreter::on_eof()
+{
+    results_.clear();
+    for (auto const &v : values())
+        results_.push_back(v.to_expr());
+    is_finished_ = true;
+}
+
+expr_list_type const& Interpreter::results() const
+{
+    if (!is_finished_)
+        throw Error("Interpreter has not finished evaluation");
+    return results_;
 }
 
 expr_list_type eval(env_ptr env, expr_list_type const &src)
@@ -185,6 +521,23 @@ ListAccessor & operator >> (ListAccessor &src, expr_ptr dst)
     return src;
 }
 
+bool ValueAccessor::optional(Value &dst)
+{
+    if (!has_more())
+        return false;
+
+    dst = *cur++;
+    return true;
+}
+
+Value const &ValueAccessor::required()
+{
+    if (cur == end)
+        throw Error("Required param is absent");
+
+    return *cur++;
+}
+
 expr_ptr ListAccessor::required()
 {
     if (cur == end)
@@ -200,13 +553,13 @@ std::basic_ostream<char> & operator <<
 expr_ptr List::do_eval(env_ptr env, expr_ptr p)
 {
     expr_list_type res;
-    auto self = std::dynamic_pointer_cast<List>(p);
+    auto self = dynamic_pointer_cast<List>(p);
     if (!self)
         return mk_nil();
     auto &src = self->items;
     for (auto &v : src)
         res.push_back(eval(env, v));
-    return std::make_shared<List>(std::move(res));
+    return expr_ptr(new List(std::move(res)));
 }
 
 } // notlisp
@@ -0,0 +1,198 @@
+#include <cor/pool.hpp>
+#include <cor/error.hpp>
+
+#include <mutex>
+#include <atomic>
+
+#include <pthread.h>
+
+namespace cor
+{
+
+namespace {
+
+static const size_t granularity = 16;
+static const size_t classes = pool_max_size / granularity;
+// blocks moved between thread and global lists at once
+static const size_t batch = 64;
+static const size_t chunk_size = 16 * 1024;
+
+struct Block
+{
+    Block *next;
+};
+
+/// list of blocks of the same size
+struct FreeList
+{
+    void push(Block *b)
+    {
+        b->next = head;
+        head = b;
+        ++size;
+    }
+
+    Block *pop()
+    {
+        auto b = head;
+        head = b->next;
+        --size;
+        return b;
+    }
+
+    /// move up to count blocks to dst
+    void move_to(FreeList &dst, size_t count)
+    {
+        for (; count && head; --count)
+            dst.push(pop());
+    }
+
+    Block *head;
+    size_t size;
+};
+
+std::atomic<size_t> chunks_count(0);
+
+/// free blocks shared between threads
+class GlobalPool
+{
+public:
+    /// fill the empty list with blocks
+    void refill(FreeList &dst, size_t cls)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            lists_[cls].move_to(dst, batch);
+        }
+        if (dst.head)
+            return;
+        // new chunk is split into blocks
+        size_t size = (cls + 1) * granularity;
+        size_t count = std::max(chunk_size / size, batch);
+        auto p = static_cast<char*>(::operator new(size * count));
+        ++chunks_count;
+        for (size_t i = 0; i < count; ++i)
+            dst.push(reinterpret_cast<Block*>(p + i * size));
+    }
+
+    void release(FreeList &src, size_t cls, size_t count)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        src.move_to(lists_[cls], count);
+    }
+
+private:
+    std::mutex mutex_;
+    FreeList lists_[classes] = {};
+};
+
+GlobalPool &global_pool()
+{
+    // never destroyed: blocks can be freed by static destructors
+    static GlobalPool *pool = new GlobalPool();
+    return *pool;
+}
+
+/// free blocks of the thread, passed to the global pool on the thread
+/// exit. It is POD, so thread-local access does not need the
+/// initialization check
+struct ThreadPool
+{
+    enum State {
+        Unused = 0,
+        Active,
+        // pool is released but blocks are still used by destructors of
+        // thread-local or static objects
+        Gone
+    };
+
+    State state;
+    FreeList lists[classes];
+};
+
+__thread ThreadPool thread_pool __attribute__((tls_model("initial-exec")));
+
+pthread_key_t exit_key;
+pthread_once_t exit_key_once = PTHREAD_ONCE_INIT;
+
+void release_thread_pool(void *)
+{
+    for (size_t cls = 0; cls < classes; ++cls) {
+        auto &list = thread_pool.lists[cls];
+        if (list.size)
+            global_pool().release(list, cls, list.size);
+    }
+    thread_pool.state = ThreadPool::Gone;
+}
+
+void create_exit_key()
+{
+    if (pthread_key_create(&exit_key, release_thread_pool))
+        throw cor::Error("Can't create pool thread key");
+}
+
+/// free blocks are released on the thread exit
+void activate_thread_pool()
+{
+    pthread_once(&exit_key_once, create_exit_key);
+    // value should be non-null to call the destructor
+    pthread_setspecific(exit_key, &thread_pool);
+    thread_pool.state = ThreadPool::Active;
+}
+
+size_t size_class(size_t size)
+{
+    return size ? (size - 1) / granularity : 0;
+}
+
+}
+
+void *pool_allocate(size_t size)
+{
+    if (size > pool_max_size)
+        return ::operator new(size);
+    auto cls = size_class(size);
+    if (thread_pool.state != ThreadPool::Active) {
+        if (thread_pool.state == ThreadPool::Gone) {
+            // it can be released to the pool later, so it has the
+            // class size
+            return ::operator new((cls + 1) * granularity);
+        }
+        activate_thread_pool();
+    }
+    auto &list = thread_pool.lists[cls];
+    if (!list.head)
+        global_pool().refill(list, cls);
+    return list.pop();
+}
+
+void pool_deallocate(void *p, size_t size)
+{
+    if (!p)
+        return;
+    if (size > pool_max_size) {
+        ::operator delete(p);
+        return;
+    }
+    auto cls = size_class(size);
+    if (thread_pool.state != ThreadPool::Active) {
+        if (thread_pool.state == ThreadPool::Gone) {
+            FreeList list = {nullptr, 0};
+            list.push(static_cast<Block*>(p));
+            global_pool().release(list, cls, 1);
+            return;
+        }
+        activate_thread_pool();
+    }
+    auto &list = thread_pool.lists[cls];
+    list.push(static_cast<Block*>(p));
+    if (list.size > 2 * batch)
+        global_pool().release(list, cls, batch);
+}
+
+size_t pool_chunks()
+{
+    return chunks_count;
+}
+
+}
@@ -1,9 +1,78 @@
 #include <cor/sexp_impl.hpp>
 
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <locale.h>
+
 namespace cor {
 namespace sexp {
 
+namespace {
+
+locale_t c_locale()
+{
+    static locale_t const locale = newlocale(LC_ALL_MASK, "C", 0);
+    return locale;
+}
+
+}
+
+double c_strtod(char const *src, size_t len)
+{
+    char buf[64];
+    std::string copy;
+    char const *str = buf;
+    // source is not null-terminated
+    if (len < sizeof(buf)) {
+        memcpy(buf, src, len);
+        buf[len] = 0;
+    } else {
+        copy.assign(src, len);
+        str = copy.c_str();
+    }
+    return strtod_l(str, nullptr, c_locale());
+}
+
+size_t c_dtostr(double v, char *dst, size_t size)
+{
+    // formatting uses the thread locale, it is switched only for the
+    // current thread
+    auto prev = uselocale(c_locale());
+    // %g drops trailing zeroes, so the least precision giving the same
+    // value gives the shortest text. If the precision gives the same
+    // value, larger ones give it too, and 17 digits are always enough
+    int lo = 1, hi = 17, len = 0;
+    while (lo < hi) {
+        int precision = lo + (hi - lo) / 2;
+        len = snprintf(dst, size, "%.*g", precision, v);
+        if (len < 0 || size_t(len) >= size)
+            break;
+        if (c_strtod(dst, len) == v)
+            hi = precision;
+        else
+            lo = precision + 1;
+    }
+    if (lo == hi)
+        len = snprintf(dst, size, "%.*g", lo, v);
+    uselocale(prev);
+    if (len < 0 || size_t(len) >= size)
+        throw cor::Error("Buffer is too small to format %g", v);
+    // integral value should be read back as the real
+    if (strspn(dst, "-0123456789") == size_t(len) && size_t(len) + 2 < size) {
+        memcpy(dst + len, ".0", 3);
+        len += 2;
+    }
+    return len;
+}
+
 template
 void parse(std::basic_istream<char> &src, AbstractHandler &handler);
 
+template
+void parse(char const *src, size_t len, AbstractHandler &handler);
+
+template
+void parse_file(std::string const &path, AbstractHandler &handler);
+
 }}
@@ -0,0 +1,74 @@
+#include <cor/sexp_binary.hpp>
+
+#include <limits>
+
+namespace cor {
+namespace sexp {
+
+namespace binary {
+
+bool parse_integer(StringRef const &s, int64_t &v)
+{
+    auto p = s.begin(), end = s.end();
+    bool is_negative = (p != end && *p == '-');
+    if (is_negative)
+        ++p;
+    // 0 is the only number starting from '0', "-0" is not canonical
+    if (p == end || (*p == '0' && (end - p > 1 || is_negative)))
+        return false;
+
+    uint64_t limit = is_negative
+        ? uint64_t(std::numeric_limits<int64_t>::max()) + 1
+        : uint64_t(std::numeric_limits<int64_t>::max());
+    uint64_t res = 0;
+    for (; p != end; ++p) {
+        unsigned d = (unsigned char)*p - '0';
+        if (d > 9 || res > (limit - d) / 10)
+            return false;
+        res = res * 10 + d;
+    }
+    v = is_negative ? int64_t(0 - res) : int64_t(res);
+    return true;
+}
+
+}
+
+void BinaryWriter::put(binary::Tag tag, StringRef const &s)
+{
+    auto p = out_.reserve(1 + binary::max_varint_len + s.size());
+    *p++ = tag;
+    p = binary::put_varint(p, s.size());
+    memcpy(p, s.data(), s.size());
+    out_.commit(p + s.size());
+}
+
+void BinaryWriter::on_atom(StringRef &&s)
+{
+    int64_t v;
+    if (binary::parse_integer(s, v))
+        put_integer(v);
+    else
+        put(binary::tag_atom, s);
+}
+
+void BinaryWriter::put_integer(int64_t v)
+{
+    auto p = out_.reserve(1 + binary::max_varint_len);
+    *p++ = binary::tag_integer;
+    out_.commit(binary::put_varint(p, binary::zigzag(v)));
+}
+
+void BinaryWriter::put_real(double v)
+{
+    if (!std::isfinite(v))
+        throw cor::Error("Not finite real can't be encoded: %g", v);
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    auto p = out_.reserve(9);
+    *p++ = binary::tag_real;
+    for (int i = 0; i < 8; ++i, bits >>= 8)
+        *p++ = char(bits & 0xff);
+    out_.commit(p);
+}
+
+}}
@@ -0,0 +1,99 @@
+#include <cor/sexp_document.hpp>
+#include <cor/sexp_impl.hpp>
+
+#include <limits>
+
+namespace cor {
+namespace sexp {
+
+Document::Document(size_t size_hint)
+{
+    // rough estimation for the typical configuration data: token per
+    // 8 bytes and most of input goes to tokens
+    tape_.reserve(size_hint / 8 + 1);
+    arena_.reserve(size_hint);
+}
+
+Document::Document(Document &&from)
+    : tape_(std::move(from.tape_))
+    , arena_(std::move(from.arena_))
+    , open_(std::move(from.open_))
+{}
+
+void Document::on_list_begin()
+{
+    open_.push_back(tape_.size());
+    tape_.push_back(Entry{List, 0, 0});
+}
+
+void Document::on_list_end()
+{
+    // parser rejects unexpected list end, so there is an open list
+    auto begin = open_.back();
+    open_.pop_back();
+    tape_[begin].pos = tape_.size();
+    tape_.push_back(Entry{ListEnd, 0, begin});
+}
+
+void Document::on_eof()
+{
+    // parser accepts lists not closed at the end of the input, close
+    // them to keep begin and end entries linked
+    while (!open_.empty())
+        on_list_end();
+    // the end of the implicit top-level list
+    tape_.push_back(Entry{ListEnd, 0, tape_.size()});
+}
+
+void Document::add(Kind kind, StringRef const &s)
+{
+    if (s.size() > std::numeric_limits<uint32_t>::max())
+        throw cor::Error("Token is too long: %zu", s.size());
+    tape_.push_back(Entry{uint32_t(kind), uint32_t(s.size()), arena_.size()});
+    arena_.append(s.data(), s.size());
+}
+
+Document::Value Document::Value::at(size_t n) const
+{
+    auto v = first();
+    for (; n && !v.is_end(); --n)
+        v = v.next();
+    return v;
+}
+
+size_t Document::Value::count() const
+{
+    size_t res = 0;
+    for (auto v = first(); !v.is_end(); v = v.next())
+        ++res;
+    return res;
+}
+
+Document::Value Document::Value::find_sibling(StringRef const &name) const
+{
+    auto v = *this;
+    for (; !v.is_end(); v = v.next()) {
+        auto head = v.first();
+        if (v.is_list() && head.is_atom() && head.value() == name)
+            break;
+    }
+    return v;
+}
+
+Document mk_document(char const *src, size_t len)
+{
+    Document res(len);
+    parse(src, len, res);
+    return res;
+}
+
+template
+void parse(std::basic_istream<char> &src, Document &handler);
+
+template
+void parse(char const *src, size_t len, Document &handler);
+
+template
+void parse_file(std::string const &path, Document &handler);
+
+}}
@@ -0,0 +1,219 @@
+#include <cor/sexp_hash.hpp>
+#include <cor/sexp_impl.hpp>
+
+#include <map>
+#include <unordered_map>
+
+namespace cor {
+namespace sexp {
+
+namespace {
+
+typedef HashTree::hash_type hash_type;
+
+hash_type const fnv_offset = 14695981039346656037ULL;
+hash_type const fnv_prime = 1099511628211ULL;
+
+/// 64-bit finalizer from MurmurHash3
+hash_type mix(hash_type h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+hash_type token_hash(StringRef const &s)
+{
+    hash_type h = fnv_offset;
+    for (auto p = s.data(), end = p + s.size(); p != end; ++p)
+        h = (h ^ static_cast<unsigned char>(*p)) * fnv_prime;
+    return h ^ s.size();
+}
+
+/// order-dependent combination of the list state and the item
+hash_type combine(hash_type state, unsigned kind, hash_type item)
+{
+    return mix((state ^ item) + 0x9e3779b97f4a7c15ULL * kind);
+}
+
+}
+
+HashTree::HashTree()
+    : events_(0)
+{
+    begin(npos);
+}
+
+void HashTree::begin(size_t parent)
+{
+    auto index = nodes_.size();
+    nodes_.push_back(Node{0, 0, parent, npos, npos, events_, heads_.size(),
+                0, false});
+    if (parent != npos) {
+        auto &open = open_.back();
+        if (open.last_child == npos)
+            nodes_[parent].first_child = index;
+        else
+            nodes_[open.last_child].next_sibling = index;
+        open.last_child = index;
+    }
+    open_.push_back(Open{index, npos, fnv_offset, fnv_offset, 0});
+}
+
+void HashTree::end()
+{
+    auto const &open = open_.back();
+    auto &node = nodes_[open.node];
+    node.hash = mix(open.state ^ open.count);
+    node.items_hash = open.items_state;
+    auto hash = node.hash;
+    open_.pop_back();
+    if (!open_.empty()) {
+        auto &parent = open_.back();
+        parent.state = combine(parent.state, List, hash);
+        ++parent.count;
+    }
+}
+
+void HashTree::on_list_begin()
+{
+    begin(open_.back().node);
+    ++events_;
+}
+
+void HashTree::on_list_end()
+{
+    // parser rejects unexpected list end, so there is an open list
+    end();
+    ++events_;
+}
+
+void HashTree::on_eof()
+{
+    // parser accepts lists not closed at the end of the input, they
+    // are closed here together with the top-level one
+    while (!open_.empty())
+        end();
+}
+
+void HashTree::add(ItemKind kind, StringRef const &s)
+{
+    auto &open = open_.back();
+    auto h = token_hash(s);
+    if (!open.count && kind == Atom && open.node) {
+        auto &node = nodes_[open.node];
+        node.has_head = true;
+        node.head_pos = heads_.size();
+        node.head_size = s.size();
+        heads_.append(s.data(), s.size());
+    }
+    open.state = combine(open.state, kind, h);
+    open.items_state = combine(open.items_state, kind, h);
+    ++open.count;
+    ++events_;
+}
+
+namespace {
+
+class Diff
+{
+public:
+    Diff(HashTree const &from, HashTree const &to,
+         std::vector<Change> &changes)
+        : from_(from), to_(to), changes_(changes)
+    {}
+
+    void compare(size_t a, size_t b);
+
+private:
+    typedef std::pair<bool, std::string> head_type;
+
+    head_type head(HashTree const &tree, size_t i) const
+    {
+        return head_type(tree.node(i).has_head, tree.head(i).str());
+    }
+
+    HashTree const &from_;
+    HashTree const &to_;
+    std::vector<Change> &changes_;
+};
+
+void Diff::compare(size_t a, size_t b)
+{
+    auto const &from = from_.node(a), &to = to_.node(b);
+    if (from.hash == to.hash)
+        return;
+
+    auto const npos = HashTree::npos;
+    auto reported = changes_.size();
+
+    // equal nested lists are unchanged
+    std::vector<size_t> children;
+    std::unordered_multimap<hash_type, size_t> by_hash;
+    for (auto i = to.first_child; i != npos; i = to_.node(i).next_sibling) {
+        by_hash.insert(std::make_pair(to_.node(i).hash, children.size()));
+        children.push_back(i);
+    }
+    std::vector<bool> is_matched(children.size(), false);
+    std::vector<size_t> removed;
+    for (auto i = from.first_child; i != npos;
+         i = from_.node(i).next_sibling) {
+        auto it = by_hash.find(from_.node(i).hash);
+        if (it != by_hash.end()) {
+            is_matched[it->second] = true;
+            by_hash.erase(it);
+        } else {
+            removed.push_back(i);
+        }
+    }
+
+    // the rest is matched by heads in order
+    std::map<head_type, std::vector<size_t> > by_head;
+    for (size_t n = 0; n < children.size(); ++n)
+        if (!is_matched[n])
+            by_head[head(to_, children[n])].push_back(children[n]);
+    std::map<head_type, size_t> used;
+    for (auto i : removed) {
+        auto h = head(from_, i);
+        auto candidates = by_head.find(h);
+        auto &n = used[h];
+        if (candidates == by_head.end() || n == candidates->second.size()) {
+            changes_.push_back(Change{Change::Removed, i, npos});
+            continue;
+        }
+        compare(i, candidates->second[n++]);
+    }
+    for (auto const &candidates : by_head) {
+        auto it = used.find(candidates.first);
+        size_t n = (it == used.end()) ? 0 : it->second;
+        for (; n < candidates.second.size(); ++n)
+            changes_.push_back
+                (Change{Change::Added, npos, candidates.second[n]});
+    }
+
+    if (from.items_hash != to.items_hash || changes_.size() == reported)
+        changes_.push_back(Change{Change::Changed, a, b});
+}
+
+}
+
+std::vector<Change> diff(HashTree const &from, HashTree const &to)
+{
+    std::vector<Change> res;
+    Diff(from, to, res).compare(0, 0);
+    return res;
+}
+
+template
+void parse(std::basic_istream<char> &src, HashTree &handler);
+
+template
+void parse(char const *src, size_t len, HashTree &handler);
+
+template
+void parse_file(std::string const &path, HashTree &handler);
+
+}}
@@ -0,0 +1,168 @@
+#include <cor/sexp_index.hpp>
+#include <cor/sexp_lexer.hpp>
+#include <cor/sexp_writer.hpp>
+
+#include <vector>
+#include <utility>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+namespace cor {
+namespace sexp {
+
+/*
+ * Sidecar consists of records:
+ *
+ * - ("key" offset size) - indexed form
+ * - (indexed size) - size of the indexed data, preceding records are
+ *   valid up to this size. Records after the last such one (incomplete
+ *   or broken) are ignored
+ */
+
+namespace {
+
+size_t get_size(Lexer &lexer)
+{
+    auto const &t = lexer.next();
+    long v = 0;
+    double r;
+    if (t.kind != Lexer::Atom || classify_atom
+        (t.value.begin(), t.value.end(), v, r) != integer_atom || v < 0)
+        throw Error(t.pos, "Expected size");
+    return size_t(v);
+}
+
+}
+
+Index::Index(std::string const &path)
+    : path_(path)
+    , index_path_(path + ".idx")
+    , indexed_(0)
+    , is_appendable_(false)
+{
+    load();
+}
+
+void Index::reset()
+{
+    keys_.clear();
+    indexed_ = 0;
+    is_appendable_ = false;
+}
+
+void Index::load()
+{
+    if (::access(index_path_.c_str(), F_OK) < 0)
+        return;
+
+    MappedFile src(index_path_);
+    Lexer lexer(src.data(), src.size());
+    std::vector<std::pair<std::string, Entry> > pending;
+    size_t valid_end = 0;
+    try {
+        while (lexer.next().kind == Lexer::ListBegin) {
+            auto const &head = lexer.next();
+            bool is_indexed = false;
+            if (head.kind == Lexer::String) {
+                std::string key(head.value.str());
+                auto offset = get_size(lexer);
+                pending.push_back({key, {offset, get_size(lexer)}});
+            } else if (head.kind == Lexer::Atom && head.value == "indexed") {
+                indexed_ = get_size(lexer);
+                for (auto &v : pending)
+                    keys_[v.first] = v.second;
+                pending.clear();
+                is_indexed = true;
+            } else {
+                throw Error(head.pos, "Unexpected index record");
+            }
+            if (lexer.next().kind != Lexer::ListEnd)
+                throw Error(lexer.token().pos, "Expected record end");
+            // records are written on separate lines by the Writer
+            if (is_indexed)
+                valid_end = lexer.position() + 1;
+        }
+        if (lexer.token().kind != Lexer::End)
+            throw Error(lexer.token().pos, "Expected index record");
+    } catch (Error const &) {
+        // records up to the last (indexed) one are valid, the rest is
+        // overwritten on the next update
+        is_appendable_ = false;
+        return;
+    }
+    // incomplete records are overwritten on the next update
+    is_appendable_ = (valid_end == src.size());
+}
+
+size_t Index::update()
+{
+    MappedFile src(path_);
+    if (src.size() < indexed_)
+        reset();
+
+    std::vector<std::pair<std::string, Entry> > added;
+    auto base = indexed_;
+    auto data = src.data(), end = data + src.size();
+    ScannedItem<char> item;
+    // incomplete item at the end is indexed by the next update after
+    // it is completed
+    for (auto p = data + base; scan_item(data, p, end, item); p = item.end) {
+        indexed_ = item.end - data;
+        // top-level atoms and strings have no head
+        if (!item.head)
+            continue;
+        std::string key(item.head, item.head_size);
+        if (item.is_head_escaped) {
+            Lexer lexer(item.head, item.head_size);
+            key = lexer.next().value.str();
+        }
+        size_t begin = item.begin - data;
+        added.push_back({std::move(key), {begin, indexed_ - begin}});
+    }
+
+    if (indexed_ == base && is_appendable_)
+        return 0;
+
+    FdHandle fd(::open(index_path_.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC
+                       | (is_appendable_ ? O_APPEND : O_TRUNC), 0644));
+    if (!fd.is_valid())
+        throw CError(errno, "Can't open " + index_path_);
+
+    Writer out(fd.value());
+    auto put_size = [&out](size_t v) {
+        out.on_atom(std::to_string(v));
+    };
+    auto put = [&](std::pair<std::string, Entry> const &v) {
+        out.on_list_begin();
+        out.on_string(v.first);
+        put_size(v.second.offset);
+        put_size(v.second.size);
+        out.on_list_end();
+    };
+    // sidecar is rewritten
+    if (!is_appendable_)
+        for (auto const &v : keys_)
+            put(v);
+    for (auto const &v : added)
+        put(v);
+    out.on_list_begin();
+    out.on_atom("indexed");
+    put_size(indexed_);
+    out.on_list_end();
+    out.on_eof();
+    is_appendable_ = true;
+
+    for (auto &v : added)
+        keys_[v.first] = v.second;
+    return added.size();
+}
+
+Index::Entry const *Index::find(std::string const &key) const
+{
+    auto it = keys_.find(key);
+    return it != keys_.end() ? &it->second : nullptr;
+}
+
+}}
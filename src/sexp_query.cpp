@@ -0,0 +1,88 @@
+#include <cor/sexp_query.hpp>
+
+namespace cor {
+namespace sexp {
+
+QueryPath::QueryPath(std::string const &path)
+{
+    auto error = [&path](char const *info) {
+        return cor::Error("Wrong query path '%s': %s", path.c_str(), info);
+    };
+
+    size_t pos = 0, end = path.size();
+    while (pos < end) {
+        auto step_end = std::min(path.find('/', pos), path.find('[', pos));
+        if (step_end == std::string::npos)
+            step_end = end;
+        std::string name(path, pos, step_end - pos);
+        if (name.empty())
+            throw error("empty step");
+        if (name == "**")
+            steps_.push_back(Step{AnyDepth, ""});
+        else if (name == "*")
+            steps_.push_back(Step{AnyName, ""});
+        else
+            steps_.push_back(Step{Name, name});
+        pos = step_end;
+        if (pos == end)
+            break;
+        if (path[pos] == '/') {
+            if (++pos == end)
+                throw error("empty step");
+            continue;
+        }
+        // predicates of the last step
+        while (pos < end) {
+            if (path[pos] != '[')
+                throw error("predicates should be at the end");
+            auto close = path.find(']', pos);
+            auto eq = path.find('=', pos);
+            if (close == std::string::npos || eq > close)
+                throw error("predicate should be [key=value]");
+            predicates_.push_back
+                (Predicate{path.substr(pos + 1, eq - pos - 1),
+                        path.substr(eq + 1, close - eq - 1)});
+            pos = close + 1;
+        }
+    }
+    if (steps_.empty())
+        throw error("no steps");
+    if (steps_.size() >= sizeof(set_type) * 8)
+        throw error("too many steps");
+    start_ = closure(1);
+}
+
+QueryPath::set_type QueryPath::closure(set_type s) const
+{
+    for (size_t i = 0; i < steps_.size(); ++i)
+        if (steps_[i].kind == AnyDepth && (s & (set_type(1) << i)))
+            s |= set_type(1) << (i + 1);
+    return s;
+}
+
+QueryPath::set_type QueryPath::advance
+(set_type from, StringRef const *head) const
+{
+    set_type res = 0;
+    for (size_t i = 0; i < steps_.size(); ++i) {
+        if (!(from & (set_type(1) << i)))
+            continue;
+        auto const &step = steps_[i];
+        switch (step.kind) {
+        case AnyDepth:
+            res |= set_type(1) << i;
+            break;
+        case AnyName:
+            if (head)
+                res |= set_type(1) << (i + 1);
+            break;
+        case Name:
+            if (head && *head == step.name)
+                res |= set_type(1) << (i + 1);
+            break;
+        }
+    }
+    return closure(res);
+}
+
+}}
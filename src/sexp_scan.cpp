@@ -0,0 +1,201 @@
+#include <cor/sexp_impl.hpp>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define COR_SEXP_SCAN_X86
+#include <immintrin.h>
+#endif
+
+namespace cor {
+namespace sexp {
+
+namespace {
+
+Scanner<char> const scalar = {
+    &scan_atom<char>, &scan_string<char>, &scan_comment<char>,
+    &scan_structure<char>
+};
+
+#ifdef COR_SEXP_SCAN_X86
+
+// Blocks of 16 (SSE2) or 32 (AVX2) bytes are checked at once, the
+// remainder shorter than a block is processed by the scalar code.
+//
+// AVX2 code is compiled using target attribute and chosen in runtime,
+// so each instruction set has own copy of the scanning loop: code is
+// not shared to avoid calls between functions with different targets
+
+#ifdef __SSE2__
+
+struct Sse2
+{
+    typedef __m128i vector_type;
+    typedef vector_type (*match_type)(vector_type);
+    static const int size = 16;
+
+    static vector_type eq(vector_type v, char c)
+    {
+        return _mm_cmpeq_epi8(v, _mm_set1_epi8(c));
+    }
+
+    static vector_type either(vector_type a, vector_type b)
+    {
+        return _mm_or_si128(a, b);
+    }
+
+    static vector_type atom_end(vector_type v)
+    {
+        // whitespaces 9..13 are mapped to -128..-124
+        vector_type t = _mm_add_epi8(v, _mm_set1_epi8(128 - 9));
+        vector_type space = either
+            (eq(v, ' '), _mm_cmplt_epi8(t, _mm_set1_epi8(-128 + 5)));
+        return either(either(space, eq(v, '\\')),
+                      either(eq(v, '('), eq(v, ')')));
+    }
+
+    static vector_type string_end(vector_type v)
+    {
+        return either(eq(v, '"'), eq(v, '\\'));
+    }
+
+    static vector_type comment_end(vector_type v)
+    {
+        return eq(v, '\n');
+    }
+
+    static vector_type structure(vector_type v)
+    {
+        return either(either(either(eq(v, '('), eq(v, ')')), eq(v, '\\')),
+                      either(eq(v, '"'), eq(v, ';')));
+    }
+
+    template <match_type Match, char const *(*Tail)(char const*, char const*)>
+    static char const *scan(char const *p, char const *end)
+    {
+        for (; end - p >= size; p += size) {
+            auto v = _mm_loadu_si128(reinterpret_cast<vector_type const*>(p));
+            unsigned m = _mm_movemask_epi8(Match(v));
+            if (m)
+                return p + __builtin_ctz(m);
+        }
+        return Tail(p, end);
+    }
+};
+
+Scanner<char> const sse2 = {
+    &Sse2::scan<&Sse2::atom_end, &scan_atom<char> >,
+    &Sse2::scan<&Sse2::string_end, &scan_string<char> >,
+    &Sse2::scan<&Sse2::comment_end, &scan_comment<char> >,
+    &Sse2::scan<&Sse2::structure, &scan_structure<char> >
+};
+
+#endif // __SSE2__
+
+#define COR_AVX2 __attribute__((target("avx2")))
+
+struct Avx2
+{
+    typedef __m256i vector_type;
+    typedef vector_type (*match_type)(vector_type);
+    static const int size = 32;
+
+    static COR_AVX2 vector_type eq(vector_type v, char c)
+    {
+        return _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c));
+    }
+
+    static COR_AVX2 vector_type either(vector_type a, vector_type b)
+    {
+        return _mm256_or_si256(a, b);
+    }
+
+    static COR_AVX2 vector_type atom_end(vector_type v)
+    {
+        // whitespaces 9..13 are mapped to -128..-124
+        vector_type t = _mm256_add_epi8(v, _mm256_set1_epi8(128 - 9));
+        vector_type space = either
+            (eq(v, ' '), _mm256_cmpgt_epi8(_mm256_set1_epi8(-128 + 5), t));
+        return either(either(space, eq(v, '\\')),
+                      either(eq(v, '('), eq(v, ')')));
+    }
+
+    static COR_AVX2 vector_type string_end(vector_type v)
+    {
+        return either(eq(v, '"'), eq(v, '\\'));
+    }
+
+    static COR_AVX2 vector_type comment_end(vector_type v)
+    {
+        return eq(v, '\n');
+    }
+
+    static COR_AVX2 vector_type structure(vector_type v)
+    {
+        return either(either(either(eq(v, '('), eq(v, ')')), eq(v, '\\')),
+                      either(eq(v, '"'), eq(v, ';')));
+    }
+
+    template <match_type Match, char const *(*Tail)(char const*, char const*)>
+    static COR_AVX2 char const *scan(char const *p, char const *end)
+    {
+        for (; end - p >= size; p += size) {
+            auto v = _mm256_loadu_si256
+                (reinterpret_cast<vector_type const*>(p));
+            unsigned m = _mm256_movemask_epi8(Match(v));
+            if (m)
+                return p + __builtin_ctz(m);
+        }
+        return Tail(p, end);
+    }
+};
+
+Scanner<char> const avx2 = {
+    &Avx2::scan<&Avx2::atom_end, &scan_atom<char> >,
+    &Avx2::scan<&Avx2::string_end, &scan_string<char> >,
+    &Avx2::scan<&Avx2::comment_end, &scan_comment<char> >,
+    &Avx2::scan<&Avx2::structure, &scan_structure<char> >
+};
+
+#endif // COR_SEXP_SCAN_X86
+
+Scanner<char> const *best_scanner()
+{
+    static const ScanImpl impls[] = { scan_avx2, scan_sse2 };
+    for (auto impl : impls) {
+        auto res = get_scanner(impl);
+        if (res)
+            return res;
+    }
+    return &scalar;
+}
+
+} // namespace
+
+Scanner<char> const *get_scanner(ScanImpl impl)
+{
+    switch (impl) {
+    case scan_scalar:
+        return &scalar;
+    case scan_sse2:
+#if defined(COR_SEXP_SCAN_X86) && defined(__SSE2__)
+        return &sse2;
+#else
+        break;
+#endif
+    case scan_avx2:
+#ifdef COR_SEXP_SCAN_X86
+        if (__builtin_cpu_supports("avx2"))
+            return &avx2;
+#endif
+        break;
+    }
+    return nullptr;
+}
+
+template <>
+Scanner<char> const &default_scanner<char>()
+{
+    static Scanner<char> const *res = best_scanner();
+    return *res;
+}
+
+}}
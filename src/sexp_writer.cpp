@@ -0,0 +1,223 @@
+#include <cor/sexp_writer.hpp>
+#include <cor/sexp_impl.hpp>
+
+#include <algorithm>
+
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+namespace cor {
+namespace sexp {
+
+namespace {
+
+/// letters used to escape control characters: \n, \t etc.
+struct EscapeLetters
+{
+    EscapeLetters()
+    {
+        for (unsigned c = 0; c < 256; ++c)
+            letter[c] = 0;
+        for (unsigned c = 0; c < 256; ++c) {
+            auto v = (unsigned char)Tables<>::escaped[c];
+            if (v)
+                letter[v] = (char)c;
+        }
+    }
+
+    char letter[256];
+};
+
+/// max length of the escaped character: \xHH
+static const size_t max_escaped_len = 4;
+
+char *append_escaped(char *dst, char c)
+{
+    static const EscapeLetters letters;
+    static char const hex[] = "0123456789abcdef";
+    auto u = (unsigned char)c;
+    auto letter = letters.letter[u];
+    *dst++ = '\\';
+    if (letter) {
+        *dst++ = letter;
+    } else if (u < 0x20) {
+        *dst++ = 'x';
+        *dst++ = hex[u >> 4];
+        *dst++ = hex[u & 0xf];
+    } else {
+        *dst++ = c;
+    }
+    return dst;
+}
+
+/// append s escaping characters found by the scan function, unescaped
+/// runs are copied at once
+char *append(char *dst, StringRef const &s, Scanner<char>::scan_type scan)
+{
+    auto p = s.begin(), end = s.end();
+    while (true) {
+        auto run = p;
+        p = scan(p, end);
+        memcpy(dst, run, p - run);
+        dst += p - run;
+        if (p == end)
+            break;
+        dst = append_escaped(dst, *p++);
+    }
+    return dst;
+}
+
+}
+
+OutputBuffer::OutputBuffer()
+    : fd_(-1), batch_size_(0), size_(0)
+{}
+
+OutputBuffer::OutputBuffer(int fd, size_t batch_size)
+    : fd_(fd), batch_size_(batch_size), size_(0)
+{
+    buf_.resize(batch_size + batch_size / 4);
+}
+
+OutputBuffer::~OutputBuffer()
+{
+    try {
+        flush();
+    } catch (...) {}
+}
+
+void OutputBuffer::grow(size_t size)
+{
+    buf_.resize(std::max(size, buf_.size() * 2));
+}
+
+void OutputBuffer::flush()
+{
+    if (fd_ < 0)
+        return;
+    auto p = buf_.data(), end = p + size_;
+    while (p != end) {
+        auto len = ::write(fd_, p, end - p);
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+            throw CError(errno, "Can't write s-expressions");
+        }
+        p += len;
+    }
+    size_ = 0;
+}
+
+Writer::Writer()
+    : level_(0), need_space_(false), is_string_(false)
+{}
+
+Writer::Writer(int fd, size_t batch_size)
+    : out_(fd, batch_size), level_(0), need_space_(false), is_string_(false)
+{}
+
+char *Writer::reserve(size_t len)
+{
+    auto p = out_.reserve(len + 1);
+    if (need_space_)
+        *p++ = ' ';
+    return p;
+}
+
+void Writer::written(char *end, bool need_space)
+{
+    need_space_ = need_space;
+    out_.commit(end);
+}
+
+void Writer::on_list_begin()
+{
+    auto p = reserve(1);
+    *p++ = '(';
+    ++level_;
+    written(p, false);
+}
+
+void Writer::on_list_end()
+{
+    need_space_ = false;
+    auto p = reserve(2);
+    *p++ = ')';
+    if (level_)
+        --level_;
+    // each top-level form is on the separate line
+    if (!level_)
+        *p++ = '\n';
+    written(p, level_ != 0);
+}
+
+void Writer::on_comment(StringRef &&s)
+{
+    // comment is till the end of line, so each line is commented
+    auto p = reserve(s.size() * 2 + 2);
+    auto src = s.begin(), end = s.end();
+    while (true) {
+        auto eol = scan_comment(src, end);
+        *p++ = ';';
+        memcpy(p, src, eol - src);
+        p += eol - src;
+        *p++ = '\n';
+        if (eol == end)
+            break;
+        src = eol + 1;
+    }
+    written(p, false);
+}
+
+void Writer::on_string(StringRef &&s)
+{
+    auto p = reserve(s.size() * max_escaped_len + 2);
+    *p++ = '"';
+    p = append(p, s, default_scanner<char>().string);
+    *p++ = '"';
+    written(p, true);
+}
+
+void Writer::on_string_chunk(StringRef &&s)
+{
+    auto p = reserve(s.size() * max_escaped_len + 1);
+    if (!is_string_)
+        *p++ = '"';
+    is_string_ = true;
+    p = append(p, s, default_scanner<char>().string);
+    written(p, false);
+}
+
+void Writer::on_string_end()
+{
+    auto p = reserve(2);
+    if (!is_string_)
+        *p++ = '"';
+    is_string_ = false;
+    *p++ = '"';
+    written(p, true);
+}
+
+void Writer::on_atom(StringRef &&s)
+{
+    if (s.empty())
+        throw cor::Error("Empty atom can't be written");
+    auto p = reserve(s.size() * max_escaped_len);
+    // quote and semicolon start string and comment only at the
+    // beginning of the atom
+    if (char_class(s[0]) != char_other)
+        p = append_escaped(p, s[0]);
+    else
+        *p++ = s[0];
+    p = append(p, StringRef(s.data() + 1, s.size() - 1),
+               default_scanner<char>().atom);
+    written(p, true);
+}
+
+void Writer::on_eof()
+{
+    out_.flush();
+}
+
+}}
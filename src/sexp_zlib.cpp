@@ -0,0 +1,239 @@
+#include <cor/sexp_zlib.hpp>
+
+#include <zlib.h>
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+
+namespace cor {
+namespace sexp {
+
+namespace {
+
+/// thrown by reading when the source is stopped
+struct Stopped {};
+
+/// wait for the input, the source is stopped if wake_fd is readable
+size_t read_some(int fd, int wake_fd, char *dst, size_t len)
+{
+    while (true) {
+        pollfd fds[] = {{fd, POLLIN, 0}, {wake_fd, POLLIN, 0}};
+        if (::poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            throw CError(errno, "Can't wait for compressed s-expressions");
+        }
+        if (fds[1].revents)
+            throw Stopped();
+        auto res = ::read(fd, dst, len);
+        if (res >= 0)
+            return size_t(res);
+        if (errno != EINTR && errno != EAGAIN)
+            throw CError(errno, "Can't read compressed s-expressions");
+    }
+}
+
+/// read till len bytes are read or the end of input
+size_t read_all(int fd, int wake_fd, char *dst, size_t len)
+{
+    size_t done = 0;
+    while (done < len) {
+        auto n = read_some(fd, wake_fd, dst + done, len - done);
+        if (!n)
+            break;
+        done += n;
+    }
+    return done;
+}
+
+bool is_prefix(std::string const &data, size_t len, char const *magic,
+               size_t magic_len)
+{
+    return len >= magic_len && !memcmp(data.data(), magic, magic_len);
+}
+
+/// inflate state is released on scope exit
+class Inflate
+{
+public:
+    Inflate()
+    {
+        memset(&zs_, 0, sizeof(zs_));
+        // 16: gzip format
+        if (inflateInit2(&zs_, 15 + 16) != Z_OK)
+            throw cor::Error("Can't initialize inflate");
+    }
+
+    ~Inflate() { inflateEnd(&zs_); }
+
+    z_stream zs_;
+};
+
+}
+
+CompressedSource::CompressedSource(int fd, size_t block_size, size_t blocks)
+    : fd_(fd), block_size_(block_size)
+{
+    start(blocks);
+}
+
+CompressedSource::CompressedSource
+(std::string const &path, size_t block_size, size_t blocks)
+    : file_(::open(path.c_str(), O_RDONLY | O_CLOEXEC))
+    , fd_(file_.value())
+    , block_size_(block_size)
+{
+    if (!file_.is_valid())
+        throw CError(errno, "Can't open " + path);
+    start(blocks);
+}
+
+CompressedSource::~CompressedSource()
+{
+    stop();
+}
+
+void CompressedSource::start(size_t blocks)
+{
+    if (!block_size_)
+        block_size_ = 256 * 1024;
+    blocks_.resize(std::max<size_t>(blocks, 2));
+    sizes_.resize(blocks_.size());
+    head_ = count_ = 0;
+    is_held_ = is_done_ = is_stopped_ = false;
+    worker_ = std::thread([this]() { produce(); });
+}
+
+void CompressedSource::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        is_stopped_ = true;
+    }
+    released_.notify_all();
+    // wake the worker waiting for the input
+    char c = 0;
+    while (::write(wake_.second(), &c, 1) < 0 && errno == EINTR) {}
+    if (worker_.joinable())
+        worker_.join();
+}
+
+bool CompressedSource::next(StringRef &block)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (is_held_) {
+        is_held_ = false;
+        head_ = (head_ + 1) % blocks_.size();
+        --count_;
+        released_.notify_one();
+    }
+    filled_.wait(lock, [this]() { return count_ || is_done_; });
+    if (!count_) {
+        if (error_)
+            std::rethrow_exception(error_);
+        return false;
+    }
+    is_held_ = true;
+    block = StringRef(blocks_[head_].data(), sizes_[head_]);
+    return true;
+}
+
+std::string *CompressedSource::acquire()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    released_.wait(lock, [this]() {
+            return count_ < blocks_.size() || is_stopped_;
+        });
+    if (is_stopped_)
+        return nullptr;
+    auto &res = blocks_[(head_ + count_) % blocks_.size()];
+    // blocks are allocated lazily, so small input does not require
+    // the whole queue
+    res.resize(block_size_);
+    return &res;
+}
+
+void CompressedSource::publish(size_t size)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        sizes_[(head_ + count_) % blocks_.size()] = size;
+        ++count_;
+    }
+    filled_.notify_one();
+}
+
+void CompressedSource::produce()
+{
+    try {
+        std::string in(block_size_, 0);
+        auto in_len = read_all(fd_, wake_.first(), &in[0], in.size());
+        if (is_prefix(in, in_len, "\x28\xb5\x2f\xfd", 4))
+            throw cor::Error("zstd compressed input is not supported");
+
+        if (!is_prefix(in, in_len, "\x1f\x8b", 2)) {
+            while (in_len) {
+                auto out = acquire();
+                if (!out)
+                    return;
+                memcpy(&(*out)[0], in.data(), in_len);
+                publish(in_len);
+                in_len = read_all(fd_, wake_.first(), &in[0], in.size());
+            }
+        } else {
+            Inflate inflate;
+            auto &zs = inflate.zs_;
+            zs.next_in = reinterpret_cast<Bytef*>(&in[0]);
+            zs.avail_in = in_len;
+            bool is_eof = false;
+            while (!is_eof) {
+                auto out = acquire();
+                if (!out)
+                    return;
+                zs.next_out = reinterpret_cast<Bytef*>(&(*out)[0]);
+                zs.avail_out = out->size();
+                while (zs.avail_out) {
+                    if (!zs.avail_in) {
+                        in_len = read_some(fd_, wake_.first(), &in[0],
+                                           in.size());
+                        if (!in_len) {
+                            is_eof = true;
+                            break;
+                        }
+                        zs.next_in = reinterpret_cast<Bytef*>(&in[0]);
+                        zs.avail_in = in_len;
+                    }
+                    auto rc = ::inflate(&zs, Z_NO_FLUSH);
+                    if (rc == Z_STREAM_END) {
+                        // the next gzip member can follow
+                        if (inflateReset(&zs) != Z_OK)
+                            throw cor::Error("Can't reset inflate");
+                    } else if (rc != Z_OK && rc != Z_BUF_ERROR) {
+                        throw cor::Error("Can't decompress input: %s",
+                                         zs.msg ? zs.msg : "unknown error");
+                    }
+                }
+                auto size = out->size() - zs.avail_out;
+                if (size)
+                    publish(size);
+            }
+            if (zs.total_in)
+                throw cor::Error("Compressed input is truncated");
+        }
+    } catch (Stopped const &) {
+        return;
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        error_ = std::current_exception();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        is_done_ = true;
+    }
+    filled_.notify_one();
+}
+
+}}
@@ -11,6 +11,28 @@
 #include <string>
 #include <sstream>
 #include <stdexcept>
+#include <new>
+
+#include <stdlib.h>
+
+// count of heap allocations, to check allocations made by the
+// interpreter
+static size_t allocations = 0;
+
+void *operator new(size_t size)
+{
+    ++allocations;
+    if (auto p = malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+// not inlined: otherwise GCC sees free() of the pointer returned by
+// the operator new and reports mismatched allocation functions
+__attribute__((noinline)) void operator delete(void *p) noexcept
+{
+    free(p);
+}
 
 namespace tut
 {
@@ -34,7 +56,12 @@ enum test_ids {
     tid_const,
     tid_wrong_expr,
     tid_simple_fn,
-    tid_list
+    tid_list,
+    tid_typed_atoms,
+    tid_symbols,
+    tid_allocations,
+    tid_handles,
+    tid_values
 };
 
 template<> template<>
@@ -261,4 +288,314 @@ void object::test<tid_list>()
         });
 }
 
+template<> template<>
+void object::test<tid_typed_atoms>()
+{
+    using namespace cor::notlisp;
+
+    // inf is not a number
+    env_ptr env(new Env({mk_const("inf", 1)}));
+    Interpreter interpreter(env);
+    cor::sexp::parse(std::string("-7 .5 1e2 :kw inf"), interpreter);
+    ListAccessor res(interpreter.results());
+    long i = 0, inf = 0;
+    double a = 0, b = 0;
+    res.required(to_long, i).required(to_double, a).required(to_double, b);
+    ensure_eq("int", i, -7);
+    ensure_eq("fraction", a, 0.5);
+    ensure_eq("exponent", b, 100);
+    ensure_eq("keyword", res.required()->type(), Expr::Keyword);
+    res.required(to_long, inf);
+    ensure_eq("symbol", inf, 1);
+
+    // custom converter gets the original text of numbers and keywords
+    std::vector<std::string> atoms;
+    Interpreter custom(env, [&atoms](std::string &&s) {
+            atoms.push_back(s);
+            return mk_string(s);
+        });
+    cor::sexp::parse(std::string("+7 007 1.10 1e2 :kw x"), custom);
+    ensure_eq("atoms", atoms, std::vector<std::string>
+              ({"+7", "007", "1.10", "1e2", ":kw", "x"}));
+}
+
+template<> template<>
+void object::test<tid_symbols>()
+{
+    using namespace cor::notlisp;
+
+    auto id = intern("test-symbol");
+    ensure_eq("same id", intern("test-symbol"), id);
+    ensure_eq("found", find_symbol("test-symbol"), id);
+    ensure_eq("name", symbol_name(id), "test-symbol");
+    ensure_eq("not interned", find_symbol("test-unknown"), no_symbol);
+    ensure_eq("still not interned", find_symbol("test-unknown"), no_symbol);
+
+    // the table grows, lookups see all names
+    std::vector<symbol_id> ids;
+    for (int i = 0; i < 1000; ++i)
+        ids.push_back(intern("test-many-" + std::to_string(i)));
+    for (int i = 0; i < 1000; ++i) {
+        auto name = "test-many-" + std::to_string(i);
+        ensure_eq("found " + name, find_symbol(name), ids[i]);
+        ensure_eq("name " + name, symbol_name(ids[i]), name);
+    }
+    ensure_eq("found after growth", find_symbol("test-symbol"), id);
+
+    env_ptr env(new Env({mk_const("a", 1), mk_const("a", 2)}));
+    long v = 0;
+    to_long(env->get("a"), v);
+    ensure_eq("first binding", v, 1);
+    ensure("unbound", !env->get("test-unknown"));
+
+    // symbol is created before its name is interned
+    auto sym = mk_symbol("test-late");
+    ensure("unbound late", !eval(env, sym));
+    env->set("test-late", mk_value(3));
+    to_long(eval(env, sym), v);
+    ensure_eq("bound late", v, 3);
+
+    Interpreter interpreter(env);
+    cor::sexp::parse(std::string("test-late test-unknown"), interpreter);
+    ListAccessor res(interpreter.results());
+    res.required(to_long, v);
+    ensure_eq("evaluated", v, 3);
+    ensure("unbound is null", !res.required());
+    ensure_eq("unknown atoms are not interned",
+              find_symbol("test-unknown"), no_symbol);
+}
+
+template<> template<>
+void object::test<tid_allocations>()
+{
+    using namespace cor::notlisp;
+
+    env_ptr env(new Env({
+                mk_record("msg", [](env_ptr, expr_list_type &params) {
+                        return mk_list(params); }),
+                    }));
+    std::string msg("(msg");
+    static const size_t atoms = 1000;
+    for (size_t i = 0; i < atoms / 4; ++i)
+        msg += " (msg x " + std::to_string(i) + " \"s\")";
+    msg += ")";
+
+    auto count = [&env, &msg]() {
+        auto before = allocations;
+        Interpreter interpreter(env);
+        cor::sexp::parse(msg, interpreter);
+        ensure_eq("result", interpreter.results().size(), 1);
+        return allocations - before;
+    };
+    // the pool is filled by the first message
+    count();
+    auto n = count();
+    ensure("allocations per message", n < atoms / 10);
+}
+
+namespace {
+
+class TrackedExpr : public cor::notlisp::ObjectExpr
+{
+public:
+    TrackedExpr(int &alive) : ObjectExpr("tracked"), alive_(alive)
+    {
+        ++alive_;
+    }
+    ~TrackedExpr() { --alive_; }
+private:
+    int &alive_;
+};
+
+/// integer evaluated to its double
+class DoublingExpr : public cor::notlisp::PodExpr
+{
+public:
+    DoublingExpr(long v) : PodExpr(v) {}
+protected:
+    virtual cor::notlisp::expr_ptr do_eval(cor::notlisp::env_ptr,
+                                           cor::notlisp::expr_ptr)
+    {
+        return cor::notlisp::mk_value(2 * (long)*this);
+    }
+};
+
+}
+
+template<> template<>
+void object::test<tid_handles>()
+{
+    using namespace cor::notlisp;
+
+    int alive = 0;
+    {
+        expr_ptr p(new TrackedExpr(alive));
+        ensure_eq("created", alive, 1);
+        ensure_eq("single ref", p.use_count(), 1);
+        auto copy = p;
+        ensure_eq("copied", p.use_count(), 2);
+        auto obj = dynamic_pointer_cast<ObjectExpr>(p);
+        ensure("casted", obj == p);
+        ensure_eq("casted ref", p.use_count(), 3);
+        ensure("wrong cast", !dynamic_pointer_cast<List>(p));
+        expr_ptr moved(std::move(copy));
+        ensure("moved from", copy == nullptr);
+        ensure_eq("moved", p.use_count(), 3);
+        obj.reset();
+        moved = nullptr;
+        ensure_eq("released", p.use_count(), 1);
+    }
+    ensure_eq("deleted", alive, 0);
+
+    {
+        std::shared_ptr<ObjectExpr> shared;
+        {
+            expr_ptr p(new TrackedExpr(alive));
+            using cor::notlisp::dynamic_pointer_cast;
+            shared = to_shared_ptr(dynamic_pointer_cast<ObjectExpr>(p));
+            ensure("shared cast", !!dynamic_pointer_cast<TrackedExpr>(shared));
+        }
+        ensure_eq("shared keeps reference", alive, 1);
+    }
+    ensure_eq("shared released", alive, 0);
+
+    ensure("atomic by default", !is_local_refs());
+    {
+        LocalRefs local;
+        ensure("local", is_local_refs());
+        {
+            LocalRefs nested;
+        }
+        ensure("still local", is_local_refs());
+        expr_ptr p(new TrackedExpr(alive));
+        auto copy = p;
+        ensure_eq("local refs", copy.use_count(), 2);
+        auto nil = mk_nil();
+        ensure_eq("nil is shared", nil->type(), Expr::Nil);
+    }
+    ensure_eq("local deleted", alive, 0);
+    ensure("not local", !is_local_refs());
+}
+
+template<> template<>
+void object::test<tid_values>()
+{
+    using namespace cor::notlisp;
+
+    ensure_eq("compact", sizeof(Value), 2 * sizeof(void*));
+    ensure_eq("empty", Value().kind(), Value::Empty);
+    ensure_eq("integer", Value(3L).type(), Expr::Integer);
+    ensure_eq("real", Value(0.5).as_double(), 0.5);
+    ensure_eq("boolean", Value::boolean(true).type(), Expr::Boolean);
+    ensure_eq("unboxed", Value(mk_value(7L)).kind(), Value::Integer);
+    ensure_eq("unboxed nil", Value(mk_nil()).kind(), Value::Nil);
+    ensure_eq("boxed", (long)*Value(7L).to_expr(), 7);
+    long l = 0;
+    to_long(mk_value(true), l);
+    ensure_eq("bool value is integer", l, 1);
+    bool b = false;
+    to_bool(mk_boolean(true), b);
+    ensure("boolean expr", b);
+    ensure_eq("unboxed boolean", Value(mk_boolean(true)).kind(),
+              Value::Boolean);
+    expr_ptr doubling(new DoublingExpr(2));
+    Value derived(doubling);
+    ensure_eq("derived is referenced", derived.kind(), Value::Ref);
+    to_long(eval(env_ptr(), derived), l);
+    ensure_eq("derived evaluation", l, 4);
+
+    int alive = 0;
+    {
+        expr_ptr p(new TrackedExpr(alive));
+        Value v(p);
+        ensure_eq("reference", v.kind(), Value::Ref);
+        ensure("same object", v.to_expr() == p);
+        ensure_eq("counted", p.use_count(), 2);
+        auto copy = v;
+        ensure_eq("copied", p.use_count(), 3);
+        Value moved(std::move(copy));
+        ensure_eq("moved", p.use_count(), 3);
+        v = 1L;
+        ensure_eq("replaced", p.use_count(), 2);
+    }
+    ensure_eq("deleted", alive, 0);
+
+    long sum = 0;
+    env_ptr env(new Env({
+                mk_value_record("sum", [&sum](env_ptr, value_list_type &params) {
+                        ValueAccessor src(params);
+                        long v = 0;
+                        sum = 0;
+                        while (src.has_more()) {
+                            src.required(to_long, v);
+                            sum += v;
+                        }
+                        return Value(sum);
+                    }),
+                mk_value_record("half", [](env_ptr, value_list_type &params) {
+                        double v;
+                        ValueAccessor(params).required(to_double, v);
+                        return Value(v / 2);
+                    }),
+                mk_record("box", [](env_ptr, expr_list_type &params) {
+                        return mk_list(params);
+                    })
+                    }));
+    std::string msg("(sum (sum 1 2)");
+    for (long i = 3; i <= 1000; ++i)
+        msg += " " + std::to_string(i);
+    msg += ")";
+    auto allocated = allocations;
+    Interpreter interpreter(env);
+    cor::sexp::parse(msg, interpreter);
+    ensure_eq("sum", sum, 500500);
+    // only storage of the interpreter grows
+    ensure("numbers are not allocated", allocations - allocated < 100);
+    auto const &values = interpreter.values();
+    ensure_eq("one value", values.size(), 1);
+    ensure_eq("value", values.front().as_long(), 500500);
+
+    Interpreter mixed(env);
+    cor::sexp::parse(std::string("(box (half 3.0) (sum 2 3) \"s\" nil)"), mixed);
+    auto list = dynamic_pointer_cast<List>(mixed.results().front());
+    ensure("list", !!list);
+    ListAccessor items(list->items);
+    double r;
+    long i;
+    std::string s;
+    items.required(to_double, r).required(to_long, i).required(to_string, s);
+    ensure_eq("real", r, 1.5);
+    ensure_eq("integer", i, 5);
+    ensure_eq("string", s, "s");
+    ensure_eq("unbound symbol", items.required()->type(), Expr::Nil);
+
+    Interpreter boxed(env);
+    cor::sexp::parse(std::string("1 (sum 2 3)"), boxed);
+    auto const &results = boxed.results();
+    auto first = results.front();
+    ensure("same list", &boxed.results() == &results);
+    ensure("boxed once", boxed.results().front() == first);
+    ensure_eq("all results", results.size(), 2);
+
+    Interpreter reused(env);
+    cor::sexp::parse(std::string("1"), reused);
+    ensure_eq("first input", reused.results().size(), 1);
+    cor::sexp::parse(std::string("(sum 2 3)"), reused);
+    std::vector<long> all;
+    for (auto const &p : reused.results()) {
+        to_long(p, l);
+        all.push_back(l);
+    }
+    ensure_eq("results of all input", all, std::vector<long>({1, 5}));
+
+    Interpreter wrong(env);
+    ensure_throws<cor::Error>("not an integer", [&wrong]() {
+            cor::sexp::parse(std::string("(sum 1 \"2\")"), wrong);
+        });
+    ensure_throws<cor::Error>("not a function", [&env]() {
+            Interpreter interpreter(env);
+            cor::sexp::parse(std::string("(1 2)"), interpreter);
+        });
+}
+
 }
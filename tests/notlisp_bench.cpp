@@ -0,0 +1,178 @@
+#include <cor/notlisp.hpp>
+#include <cor/sexp.hpp>
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <unordered_map>
+
+namespace {
+
+using namespace cor::notlisp;
+
+template <typename FnT>
+void measure(std::string const &name, size_t count, FnT fn)
+{
+    static const int repeat = 10;
+    double best = 0;
+    for (int i = 0; i < repeat; ++i) {
+        auto begin = std::chrono::steady_clock::now();
+        fn();
+        std::chrono::duration<double> spent
+            = std::chrono::steady_clock::now() - begin;
+        double rate = (count / 1e6) / spent.count();
+        if (rate > best)
+            best = rate;
+    }
+    std::cout << name << ": " << best << " M/s" << std::endl;
+}
+
+// results are accumulated to prevent optimizing lookups out
+size_t found = 0;
+
+void bench_env(size_t bindings, size_t lookups)
+{
+    std::vector<std::string> names, missing;
+    std::unordered_map<std::string, expr_ptr> dict;
+    Env env;
+    for (size_t i = 0; i < bindings; ++i) {
+        names.push_back("symbol-" + std::to_string(i));
+        missing.push_back("missing-" + std::to_string(i));
+        auto v = mk_value(long(i));
+        dict[names.back()] = v;
+        env.set(names.back(), v);
+    }
+    std::vector<expr_ptr> symbols;
+    for (auto const &name : names)
+        symbols.push_back(mk_symbol(name));
+    env_ptr env_p(new Env(env));
+
+    auto prefix = std::to_string(bindings) + " bindings, ";
+    measure(prefix + "unordered_map hit", lookups, [&]() {
+            for (size_t i = 0; i < lookups; ++i) {
+                auto it = dict.find(names[i % bindings]);
+                found += (it != dict.end());
+            }
+        });
+    measure(prefix + "Env by name hit", lookups, [&]() {
+            for (size_t i = 0; i < lookups; ++i)
+                found += !!env.get(names[i % bindings]);
+        });
+    std::vector<symbol_id> ids;
+    for (auto const &name : names)
+        ids.push_back(find_symbol(name));
+    measure(prefix + "Env by id hit", lookups, [&]() {
+            for (size_t i = 0; i < lookups; ++i)
+                found += !!env.get(ids[i % bindings]);
+        });
+    cor::FlatMap<std::string, expr_ptr, cor::StringRefHash,
+                 cor::StringRefEqual> flat;
+    for (auto const &name : names)
+        flat.insert(name, nullptr);
+    measure(prefix + "FlatMap hit", lookups, [&]() {
+            for (size_t i = 0; i < lookups; ++i)
+                found += !!flat.find(cor::StringRef(names[i % bindings]));
+        });
+    measure(prefix + "Env by symbol hit", lookups, [&]() {
+            for (size_t i = 0; i < lookups; ++i)
+                found += !!eval(env_p, symbols[i % bindings]);
+        });
+    measure(prefix + "unordered_map miss", lookups, [&]() {
+            for (size_t i = 0; i < lookups; ++i) {
+                auto it = dict.find(missing[i % bindings]);
+                found += (it != dict.end());
+            }
+        });
+    measure(prefix + "Env by name miss", lookups, [&]() {
+            for (size_t i = 0; i < lookups; ++i)
+                found += !!env.get(missing[i % bindings]);
+        });
+}
+
+void bench_interpreter(size_t count)
+{
+    env_ptr env(new Env({
+                mk_record("msg", [](env_ptr, expr_list_type &params) {
+                        return mk_list(params); }),
+                    }));
+    std::string msg("(msg");
+    for (size_t i = 0; i < 250; ++i)
+        msg += " (msg x " + std::to_string(i) + " \"s\")";
+    msg += ")";
+    auto run = [&]() {
+        for (size_t i = 0; i < count; ++i) {
+            Interpreter interpreter(env);
+            cor::sexp::parse(msg, interpreter);
+            found += interpreter.results().size();
+        }
+    };
+    // rate is measured in atoms
+    measure("interpreter, messages", count * 1000, run);
+    measure("interpreter, messages, local refs", count * 1000, [&]() {
+            LocalRefs local;
+            run();
+        });
+}
+
+
+void bench_numbers(size_t count)
+{
+    env_ptr env(new Env({
+                mk_record("sum", [](env_ptr, expr_list_type &params) {
+                        ListAccessor src(params);
+                        long res = 0, v;
+                        while (src.has_more()) {
+                            src.required(to_long, v);
+                            res += v;
+                        }
+                        return mk_value(res);
+                    }),
+                mk_value_record("vsum", [](env_ptr, value_list_type &params) {
+                        ValueAccessor src(params);
+                        long res = 0, v;
+                        while (src.has_more()) {
+                            src.required(to_long, v);
+                            res += v;
+                        }
+                        return Value(res);
+                    })
+                    }));
+    auto numbers = [](std::string const &name) {
+        std::string msg("(" + name);
+        for (size_t i = 0; i < 100; ++i) {
+            msg += " (" + name;
+            for (size_t j = 0; j < 9; ++j)
+                msg += " " + std::to_string(i * j);
+            msg += ")";
+        }
+        return msg + ")";
+    };
+    auto run = [&](std::string const &msg) {
+        for (size_t i = 0; i < count; ++i) {
+            Interpreter interpreter(env);
+            cor::sexp::parse(msg, interpreter);
+            found += interpreter.values().size();
+        }
+    };
+    auto boxed = numbers("sum"), values = numbers("vsum");
+    // rate is measured in atoms
+    measure("interpreter, numbers, boxed", count * 1000, [&]() {
+            run(boxed);
+        });
+    measure("interpreter, numbers, values", count * 1000, [&]() {
+            run(values);
+        });
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    size_t lookups = (argc > 1 ? std::stoul(argv[1]) : 1) * 1000 * 1000;
+    for (size_t bindings : {10, 100, 1000, 10000})
+        bench_env(bindings, lookups);
+    bench_interpreter(lookups / 1000);
+    bench_numbers(lookups / 1000);
+    return found ? 0 : 1;
+}
@@ -1,7 +1,19 @@
-#include <cor/sexp.hpp>
+#include <cor/sexp_impl.hpp>
+#include <cor/sexp_parallel.hpp>
+#include <cor/sexp_document.hpp>
+#include <cor/sexp_writer.hpp>
+#include <cor/sexp_binary.hpp>
+#include <cor/sexp_lexer.hpp>
+#include <cor/sexp_index.hpp>
+#include <cor/sexp_query.hpp>
+#include <cor/sexp_literal.hpp>
+#include <cor/sexp_hash.hpp>
+#include <cor/notlisp.hpp>
 #include <cor/util.hpp>
 #include <tut/tut.hpp>
 
+#include "tests_common.hpp"
+
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -9,6 +21,11 @@
 #include <string>
 #include <sstream>
 #include <stdexcept>
+#include <functional>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <limits>
 
 namespace tut
 {
@@ -29,7 +46,26 @@ enum test_ids {
     tid_enclosured,
     tid_comment,
     tid_string,
-    tid_atom
+    tid_atom,
+    tid_escaped,
+    tid_errors,
+    tid_refs,
+    tid_scanners,
+    tid_push,
+    tid_file,
+    tid_parallel,
+    tid_document,
+    tid_writer,
+    tid_binary,
+    tid_capabilities,
+    tid_skip,
+    tid_typed,
+    tid_string_chunks,
+    tid_lexer,
+    tid_index,
+    tid_query,
+    tid_literal,
+    tid_hash
 };
 
 namespace sexp = cor::sexp;
@@ -70,14 +106,21 @@ using cor::concat;
 static void basic_test_with
 (std::string const &exp, int enters, int exits, int depth)
 {
-    BasicTestHandler handler;
     std::string suffix(". parsing'" + exp + "'");
+    auto check = [&](BasicTestHandler const &handler) {
+        ensure_eq("depth" + suffix, handler.depth, depth);
+        ensure_eq("enters" + suffix, handler.enter_count, enters);
+        ensure_eq("exits" + suffix, handler.exit_count, exits);
+        ensure_eq("eof" + suffix, handler.is_eof, true);
+    };
+    BasicTestHandler handler;
     std::istringstream in(exp);
     cor::sexp::parse(in, static_cast<sexp::AbstractHandler&>(handler));
-    ensure_eq("depth" + suffix, handler.depth, depth);
-    ensure_eq("enters" + suffix, handler.enter_count, enters);
-    ensure_eq("exits" + suffix, handler.exit_count, exits);
-    ensure_eq("eof" + suffix, handler.is_eof, true);
+    check(handler);
+
+    BasicTestHandler buf_handler;
+    cor::sexp::parse(exp, static_cast<sexp::AbstractHandler&>(buf_handler));
+    check(buf_handler);
 };
 
 template<> template<>
@@ -104,13 +147,21 @@ static void test_with
     std::string const &exp = p.first;
     std::string const &expected = p.second;
     std::string suffix(". parsing'" + exp + "'");
+    auto check = [&](HandlerT const &handler) {
+        ensure_eq("depth" + suffix, handler.depth, depth);
+        ensure_eq("enters" + suffix, handler.enter_count, enters);
+        ensure_eq("exits" + suffix, handler.exit_count, exits);
+        ensure_eq(name + suffix, handler.data, expected);
+        ensure_eq("eof" + suffix, handler.is_eof, true);
+    };
+    HandlerT from_stream(handler);
     std::istringstream in(exp);
-    cor::sexp::parse(in, static_cast<sexp::AbstractHandler&>(handler));
-    ensure_eq("depth" + suffix, handler.depth, depth);
-    ensure_eq("enters" + suffix, handler.enter_count, enters);
-    ensure_eq("exits" + suffix, handler.exit_count, exits);
-    ensure_eq(name + suffix, handler.data, expected);
-    ensure_eq("eof" + suffix, handler.is_eof, true);
+    cor::sexp::parse(in, static_cast<sexp::AbstractHandler&>(from_stream));
+    check(from_stream);
+
+    HandlerT from_buffer(handler);
+    cor::sexp::parse(exp, static_cast<sexp::AbstractHandler&>(from_buffer));
+    check(from_buffer);
 };
 
 template<> template<>
@@ -173,4 +224,1176 @@ void object::test<tid_atom>()
     }
 }
 
+template<> template<>
+void object::test<tid_escaped>()
+{
+    struct TestHandler : public BasicTestHandler {
+        void on_string(std::string &&s) {
+            data = std::move(s);
+        }
+        void on_atom(std::string &&s) {
+            data = std::move(s);
+        }
+        std::string data;
+    };
+    TestHandler handler;
+    std::vector<compare_type> data
+        = {{"\"\\n\\t\\r\\a\\b\\v\"", "\n\t\r\a\b\v"},
+           {"\"\\x41\"", "A"}, {"\"\\x41B\"", "AB"},
+           {"\"\\x4z\"", "\x04z"}, {"\"\\x4\"", "\x04"},
+           {"a\\x41", "aA"}, {"\\(a", "(a"}, {"a\\ b", "a b"}};
+    for (auto &v : data)
+        test_with(handler, "escaped", v);
+}
+
+template<> template<>
+void object::test<tid_errors>()
+{
+    auto from_stream = [](std::string const &exp) {
+        BasicTestHandler handler;
+        std::istringstream in(exp);
+        cor::sexp::parse(in, static_cast<sexp::AbstractHandler&>(handler));
+    };
+    auto from_buffer = [](std::string const &exp) {
+        BasicTestHandler handler;
+        cor::sexp::parse(exp, static_cast<sexp::AbstractHandler&>(handler));
+    };
+    auto check = [](std::string const &exp, size_t pos,
+                    std::function<void (std::string const &)> parse) {
+        try {
+            parse(exp);
+            fail("Expected failure parsing '" + exp + "'");
+        } catch (sexp::Error const &e) {
+            ensure_eq("error position parsing '" + exp + "'", e.pos, pos);
+        }
+    };
+    std::vector<std::pair<std::string, size_t> > data
+        = {{")", 1}, {"( ))", 4}, {"\"abc", 4}, {"\"\\", 2},
+           {"\"\\xz\"", 4}, {"(() ())  )", 10}};
+    for (auto &v : data) {
+        check(v.first, v.second, from_stream);
+        check(v.first, v.second, from_buffer);
+    }
+}
+
+template<> template<>
+void object::test<tid_refs>()
+{
+    struct TestHandler {
+        typedef sexp::StringRef token_type;
+
+        TestHandler(std::string const &src) : src(src), is_eof(false) {}
+
+        void on_list_begin() { tokens.push_back("("); }
+        void on_list_end() { tokens.push_back(")"); }
+        void on_comment(sexp::StringRef s) { add(";", s); }
+        void on_string(sexp::StringRef s) { add("\"", s); }
+        void on_atom(sexp::StringRef s) { add("", s); }
+        void on_eof() { is_eof = true; }
+
+        void add(std::string const &prefix, sexp::StringRef s)
+        {
+            tokens.push_back(prefix + s.str());
+            bool is_src = (s.data() >= src.data()
+                           && s.data() + s.size() <= src.data() + src.size());
+            if (is_src)
+                refs.push_back(s.str());
+        }
+
+        std::string const &src;
+        std::list<std::string> tokens;
+        std::list<std::string> refs;
+        bool is_eof;
+    };
+    ensure("StringRef handler", sexp::HandlerTraits<TestHandler>::use_refs);
+    ensure("std::string handler",
+           !sexp::HandlerTraits<BasicTestHandler>::use_refs);
+
+    std::string src("(a \"b c\" d\\ e \"f\\x41\" ;g\n(h)) i");
+    std::list<std::string> expected
+        = {"(", "a", "\"b c", "d e", "\"fA", ";g", "(", "h", ")", ")", "i"};
+    std::list<std::string> expected_refs = {"a", "b c", "g", "h", "i"};
+
+    TestHandler from_buffer(src);
+    sexp::parse(src, from_buffer);
+    ensure_eq("eof", from_buffer.is_eof, true);
+    ensure_eq("tokens", from_buffer.tokens, expected);
+    ensure_eq("refs to source", from_buffer.refs, expected_refs);
+
+    TestHandler from_stream(src);
+    std::istringstream in(src);
+    sexp::parse(in, from_stream);
+    ensure_eq("stream tokens", from_stream.tokens, expected);
+    ensure_eq("no refs to source using stream", from_stream.refs.size(), 0);
+}
+
+template<> template<>
+void object::test<tid_scanners>()
+{
+    auto scalar = sexp::get_scanner(sexp::scan_scalar);
+    ensure("scalar scanner is always available", scalar);
+
+    // mostly atom characters with all terminators and characters
+    // surrounding them
+    static const std::string alphabet
+        = std::string(48, 'a') + " \t\n\v\f\r\x08\x0e\x1f!()\"\\;'[]"
+        + "\x7f\x80\x89\xa0\xff";
+    std::mt19937 rnd(1);
+    std::string data(4096, 'a');
+    for (auto &c : data)
+        c = alphabet[rnd() % alphabet.size()];
+    // long runs without terminators
+    std::fill(data.begin() + 1024, data.begin() + 2048, 'a');
+
+    auto check = [&](std::string const &name,
+                     sexp::Scanner<char> const &scan) {
+        auto begin = data.data();
+        for (size_t start = 0; start < data.size(); start += 7) {
+            for (auto len : {0, 1, 15, 16, 17, 31, 32, 33, 100, 2000}) {
+                auto p = begin + start;
+                auto end = std::min(p + len, begin + data.size());
+                std::string suffix = cor::concat
+                    (" ", name, " from ", start, " len ", len);
+                ensure_eq("atom" + suffix, scan.atom(p, end) - begin,
+                          scalar->atom(p, end) - begin);
+                ensure_eq("string" + suffix, scan.string(p, end) - begin,
+                          scalar->string(p, end) - begin);
+                ensure_eq("comment" + suffix, scan.comment(p, end) - begin,
+                          scalar->comment(p, end) - begin);
+                ensure_eq("structure" + suffix,
+                          scan.structure(p, end) - begin,
+                          scalar->structure(p, end) - begin);
+            }
+        }
+    };
+
+    std::vector<std::pair<std::string, sexp::ScanImpl> > impls
+        = {{"sse2", sexp::scan_sse2}, {"avx2", sexp::scan_avx2}};
+    for (auto &impl : impls) {
+        auto scan = sexp::get_scanner(impl.second);
+        if (scan)
+            check(impl.first, *scan);
+    }
+    check("default", sexp::default_scanner<char>());
+}
+
+template <typename TokenT>
+struct RecordingHandler
+{
+    typedef TokenT token_type;
+
+    RecordingHandler() : is_eof(false) {}
+
+    void on_list_begin() { tokens.push_back("("); }
+    void on_list_end() { tokens.push_back(")"); }
+    void on_comment(TokenT &&s) { add(";", s); }
+    void on_string(TokenT &&s) { add("\"", s); }
+    void on_atom(TokenT &&s) { add("", s); }
+    void on_eof() { is_eof = true; }
+
+    void add(std::string const &prefix, TokenT const &s)
+    {
+        tokens.push_back(prefix + std::string(s.begin(), s.end()));
+    }
+
+    std::list<std::string> tokens;
+    bool is_eof;
+};
+
+template<> template<>
+void object::test<tid_push>()
+{
+    std::string src
+        ("(a \"b c\" d\\ e \"f\\x41\" ;g\n(h (i j) \"\")) k ;l");
+    std::list<std::string> expected
+        = {"(", "a", "\"b c", "d e", "\"fA", ";g", "(", "h", "(", "i", "j",
+           ")", "\"", ")", ")", "k", ";l"};
+
+    auto check = [&src, &expected](size_t chunk_size) {
+        auto suffix = cor::concat(", chunk ", chunk_size);
+        RecordingHandler<std::string> handler;
+        sexp::PushParser<RecordingHandler<std::string> > parser(handler);
+        RecordingHandler<sexp::StringRef> ref_handler;
+        sexp::PushParser<RecordingHandler<sexp::StringRef> >
+            ref_parser(ref_handler);
+        for (size_t pos = 0; pos < src.size(); pos += chunk_size) {
+            // chunk is destroyed after feeding
+            std::string chunk(src.substr(pos, chunk_size));
+            parser.feed(chunk);
+            ref_parser.feed(chunk);
+            ensure_eq("position" + suffix, parser.position(),
+                      pos + chunk.size());
+            ensure_eq("no eof before finish" + suffix, handler.is_eof, false);
+        }
+        ensure_eq("all lists are closed" + suffix, parser.level(), 0);
+        parser.finish();
+        ref_parser.finish();
+        ensure_eq("eof" + suffix, handler.is_eof, true);
+        ensure_eq("tokens" + suffix, handler.tokens, expected);
+        ensure_eq("ref tokens" + suffix, ref_handler.tokens, expected);
+    };
+    for (size_t chunk_size = 1; chunk_size <= src.size(); ++chunk_size)
+        check(chunk_size);
+
+    RecordingHandler<std::string> handler;
+    sexp::PushParser<RecordingHandler<std::string> > parser(handler);
+    parser.feed("(a");
+    ensure_eq("list is opened", parser.level(), 1);
+    ensure_eq("atom is not finished", handler.tokens.size(), 1);
+    parser.feed(" b)");
+    ensure_eq("atom is finished", handler.tokens.size(), 4);
+    try {
+        parser.feed(" )");
+        fail("Expected failure parsing unbalanced ')'");
+    } catch (sexp::Error const &e) {
+        ensure_eq("error position", e.pos, 7);
+    }
+}
+
+class TempFile
+{
+public:
+    TempFile(std::string const &data)
+        : path("/tmp/cor_test_XXXXXX")
+    {
+        cor::FdHandle fd(::mkstemp(&path[0]));
+        if (!fd.is_valid())
+            throw cor::CError(errno, "Can't create temp file");
+        auto len = ::write(fd.value(), data.data(), data.size());
+        if (len != (ssize_t)data.size())
+            throw cor::CError(errno, "Can't write temp file");
+    }
+
+    ~TempFile() { ::unlink(path.c_str()); }
+
+    std::string path;
+};
+
+template<> template<>
+void object::test<tid_file>()
+{
+    std::string src("(a \"b c\" d\\ e ;f\n(g)) h");
+    std::list<std::string> expected
+        = {"(", "a", "\"b c", "d e", ";f", "(", "g", ")", ")", "h"};
+    TempFile file(src);
+    RecordingHandler<sexp::StringRef> handler;
+    sexp::parse_file(file.path, handler);
+    ensure_eq("eof", handler.is_eof, true);
+    ensure_eq("tokens", handler.tokens, expected);
+
+    TempFile empty("");
+    RecordingHandler<std::string> empty_handler;
+    sexp::parse_file(empty.path, empty_handler);
+    ensure_eq("empty file eof", empty_handler.is_eof, true);
+    ensure_eq("empty file", empty_handler.tokens.size(), 0);
+
+    TempFile wrong("(a))");
+    try {
+        RecordingHandler<std::string> wrong_handler;
+        sexp::parse_file(wrong.path, wrong_handler);
+        fail("Expected failure parsing unbalanced ')'");
+    } catch (sexp::Error const &e) {
+        ensure_eq("error position", e.pos, 4);
+    }
+
+    ensure_throws<cor::CError>("No file", []() {
+            RecordingHandler<std::string> handler;
+            sexp::parse_file("/non/existing/file", handler);
+        });
+}
+
+template<> template<>
+void object::test<tid_parallel>()
+{
+    std::string src;
+    for (int i = 0; i < 200; ++i) {
+        src += cor::concat("(form ", i, " \"str)(\\\"\" ;(comment\n");
+        src += cor::concat("(nested a\\) \"\\x29\") ) atom", i, "\\ ;x\n");
+    }
+    RecordingHandler<std::string> sequential;
+    sexp::parse(src, sequential);
+
+    auto mk_handler = []() {
+        return cor::make_unique<RecordingHandler<sexp::StringRef> >();
+    };
+    for (size_t chunk_size : {1, 16, 100, 1000, 100000}) {
+        auto suffix = cor::concat(", chunk ", chunk_size);
+        auto bounds = sexp::split_forms(src.data(), src.size(), chunk_size);
+        ensure("bounds begin" + suffix, bounds.front() == 0);
+        ensure("bounds end" + suffix, bounds.back() == src.size());
+
+        auto handlers = sexp::parse_parallel
+            (src.data(), src.size(), mk_handler, 4, chunk_size);
+        ensure_eq("handler per chunk" + suffix,
+                  handlers.size(), bounds.size() - 1);
+        std::list<std::string> tokens;
+        for (auto &h : handlers) {
+            ensure("eof" + suffix, h->is_eof);
+            tokens.insert(tokens.end(), h->tokens.begin(), h->tokens.end());
+        }
+        ensure_eq("tokens" + suffix, tokens, sequential.tokens);
+    }
+
+    std::string wrong = src + "(a))" + src + ")";
+    try {
+        sexp::parse_parallel(wrong.data(), wrong.size(), mk_handler, 4, 100);
+        fail("Expected failure parsing unbalanced ')'");
+    } catch (sexp::Error const &e) {
+        ensure_eq("first error position", e.pos, src.size() + 4);
+    }
+}
+
+template<> template<>
+void object::test<tid_document>()
+{
+    auto doc = sexp::mk_document
+        ("; config\n(server (host \"local\\x41\") (port 80))\n"
+         "(client (names a b c) ()) atom");
+    auto server = doc.root();
+    ensure("server is list", server.is_list());
+    ensure_eq("server items", server.count(), 3);
+    ensure_eq("server name", server.first().value(), "server");
+
+    auto host = server.find("host");
+    ensure("host found", host.is_list());
+    ensure("host is string", host.at(1).is_string());
+    ensure_eq("host", host.at(1).value(), "localA");
+    ensure_eq("port", server.find("port").at(1).value(), "80");
+    ensure("no user", server.find("user").is_end());
+    ensure("no item after port", server.at(3).is_end());
+
+    auto client = doc.find("client");
+    ensure("client is the 2nd form", client == server.next());
+    auto names = client.find("names");
+    ensure_eq("names", names.count(), 4);
+    ensure_eq("last name", names.at(3).value(), "c");
+    auto empty = names.next();
+    ensure("empty list", empty.is_list());
+    ensure_eq("empty list items", empty.count(), 0);
+    ensure("empty list end", empty.first().is_end());
+    ensure("client end", empty.next().is_end());
+
+    auto atom = client.next();
+    ensure("top-level atom", atom.is_atom());
+    ensure_eq("atom", atom.value(), "atom");
+    ensure("document end", atom.next().is_end());
+    ensure("no such form", doc.find("atom").is_end());
+
+    auto empty_doc = sexp::mk_document("");
+    ensure("empty document", empty_doc.root().is_end());
+
+    auto unclosed = sexp::mk_document("(a (b c");
+    auto a = unclosed.root();
+    ensure_eq("unclosed list items", a.count(), 2);
+    ensure_eq("unclosed nested list items", a.at(1).count(), 2);
+    ensure_eq("unclosed nested list", a.find("b").at(1).value(), "c");
+    ensure("unclosed document end", a.next().is_end());
+    ensure("no form in unclosed", unclosed.find("c").is_end());
+
+    sexp::Document incomplete;
+    try {
+        incomplete.root();
+        fail("Expected failure accessing incomplete document");
+    } catch (cor::Error const &) {}
+}
+
+template<> template<>
+void object::test<tid_writer>()
+{
+    std::string src("; header\n(a \"b\\\"\\\\\\n\\x01\" c\\ d\\(\\\\"
+                    " ;x\n( ) \\\"e \\;f g\\\"h\\\nj\\x0c)\natom\t(k)");
+    std::string expected("; header\n(a \"b\\\"\\\\\n\x01\" c\\ d\\(\\\\"
+                         " ;x\n() \\\"e \\;f g\"h\\nj\\x0c)\natom (k)\n");
+    sexp::Writer writer;
+    sexp::parse(src, writer);
+    ensure_eq("written", writer.str(), expected);
+
+    RecordingHandler<std::string> original, written;
+    sexp::parse(src, original);
+    sexp::parse(writer.str(), written);
+    ensure_eq("same tokens", written.tokens, original.tokens);
+
+    sexp::Writer direct;
+    direct.on_comment("multi\nline");
+    direct.on_list_begin();
+    direct.on_atom("x");
+    direct.on_string(std::string("\"\x7f\xff"));
+    direct.on_list_end();
+    ensure_eq("direct", direct.str(), ";multi\n;line\n(x \"\\\"\x7f\xff\")\n");
+    ensure_throws<cor::Error>("empty atom", [&direct]() {
+            direct.on_atom("");
+        });
+
+    struct Rename : public sexp::Filter<sexp::Writer>
+    {
+        Rename(sexp::Writer &w) : Filter(w) {}
+        void on_comment(token_type &&) {}
+        void on_atom(token_type &&s)
+        {
+            next_.on_atom(s == "a" ? token_type("renamed") : s);
+        }
+    };
+    char path[] = "/tmp/cor_test_XXXXXX";
+    cor::FdHandle fd(::mkstemp(path));
+    std::string big;
+    for (int i = 0; i < 1000; ++i)
+        big += src;
+    {
+        sexp::Writer file_writer(fd.value(), 100);
+        Rename rename(file_writer);
+        sexp::parse(big, rename);
+    }
+    RecordingHandler<std::string> renamed;
+    sexp::parse_file(path, renamed);
+    ::unlink(path);
+    ensure_eq("all forms written", renamed.tokens.size(),
+              (original.tokens.size() - 2) * 1000);
+    ensure_eq("renamed", *std::next(renamed.tokens.begin()), "renamed");
+}
+
+template<> template<>
+void object::test<tid_binary>()
+{
+    std::string src("; header\n(a \"b\\\"\\\\\\n\\x01\" c\\ d\\(\\\\"
+                    " ;x\n( ) \\\"e \\;f g\\\"h\\\nj\\x0c)\natom\t(k)"
+                    "(0 -0 007 +1 -12 1.5 9223372036854775807"
+                    " -9223372036854775808 9223372036854775808 1- -)");
+    sexp::Writer text;
+    sexp::parse(src, text);
+
+    sexp::BinaryWriter writer;
+    sexp::parse(src, writer);
+    auto encoded = writer.str();
+
+    sexp::BinaryWriter numbers;
+    sexp::parse(std::string("(0 -12 300 -0 007 +1 1.5)"), numbers);
+    ensure_eq("canonical integers are encoded", numbers.str(),
+              std::string("(i\0i\x17i\xd8\x04" "a\x02-0" "a\x03" "007"
+                          "a\x02+1" "a\x03" "1.5)", 27));
+
+    sexp::Writer decoded;
+    sexp::parse_binary(encoded, decoded);
+    ensure_eq("decoded", decoded.str(), text.str());
+    RecordingHandler<std::string> copying;
+    sexp::parse_binary(encoded, copying);
+    ensure_eq("eof", copying.is_eof, true);
+
+    sexp::BinaryWriter typed;
+    typed.on_list_begin();
+    typed.put_integer(-1);
+    typed.put_real(0.5);
+    typed.put_real(-1e300);
+    typed.put_real(2);
+    typed.put_real(0.1);
+    typed.put_real(5e-324);
+    typed.put_real(0.1 + 0.2);
+    typed.on_list_end();
+    RecordingHandler<sexp::StringRef> typed_handler;
+    sexp::parse_binary(typed.str(), typed_handler);
+    std::list<std::string> expected = {"(", "-1", "0.5", "-1e+300", "2.0", "0.1",
+                                      "5e-324", "0.30000000000000004", ")"};
+    ensure_eq("typed", typed_handler.tokens, expected);
+    ensure_throws<cor::Error>("infinity", [&typed]() {
+            typed.put_real(std::numeric_limits<double>::infinity());
+        });
+    ensure_throws<cor::Error>("NaN", [&typed]() {
+            typed.put_real(std::numeric_limits<double>::quiet_NaN());
+        });
+
+    std::vector<std::pair<std::string, size_t> > wrong
+        = {{"(", 1}, {")", 0}, {"x", 0}, {"a\x05" "abc", 2},
+           {"i\x80", 1}, {"r1234567", 1},
+           {std::string("r\0\0\0\0\0\0\xf0\x7f", 9), 1}};
+    for (auto const &v : wrong) {
+        try {
+            RecordingHandler<std::string> handler;
+            sexp::parse_binary(v.first, handler);
+            fail("Expected failure parsing " + v.first);
+        } catch (sexp::Error const &e) {
+            ensure_eq("error position for " + v.first, e.pos, v.second);
+        }
+    }
+}
+
+template<> template<>
+void object::test<tid_capabilities>()
+{
+    typedef sexp::HandlerTraits<RecordingHandler<std::string> > recording;
+    ensure("all tokens", recording::has_atoms && recording::has_strings
+           && recording::has_comments);
+    typedef sexp::HandlerTraits<sexp::AbstractHandler> abstract;
+    ensure("abstract handler", abstract::has_atoms && abstract::has_strings
+           && abstract::has_comments);
+    typedef sexp::HandlerTraits<cor::notlisp::Interpreter> interpreter;
+    ensure("interpreter", interpreter::has_atoms && interpreter::has_strings
+           && !interpreter::has_comments);
+    typedef sexp::HandlerTraits<sexp::Document> document;
+    ensure("document", document::has_atoms && !document::has_comments);
+
+    struct AtomsOnly
+    {
+        AtomsOnly() : lists(0), is_eof(false) {}
+        void on_list_begin() { ++lists; }
+        void on_list_end() {}
+        void on_atom(std::string &&s) { atoms.push_back(s); }
+        void on_eof() { is_eof = true; }
+
+        int lists;
+        bool is_eof;
+        std::list<std::string> atoms;
+    };
+    typedef sexp::HandlerTraits<AtomsOnly> atoms_only;
+    ensure("atoms only", atoms_only::has_atoms && !atoms_only::has_strings
+           && !atoms_only::has_comments);
+
+    std::string src("; (comment \"\n(a \"b\\\" (\" c\\ d ;e\n(\"\\x41\" f)) g");
+    std::list<std::string> expected = {"a", "c d", "f", "g"};
+    AtomsOnly handler;
+    sexp::parse(src, handler);
+    ensure_eq("buffer atoms", handler.atoms, expected);
+    ensure_eq("buffer lists", handler.lists, 2);
+    ensure("buffer eof", handler.is_eof);
+
+    AtomsOnly stream_handler;
+    std::istringstream in(src);
+    sexp::parse(in, stream_handler);
+    ensure_eq("stream atoms", stream_handler.atoms, expected);
+
+    AtomsOnly push_handler;
+    sexp::PushParser<AtomsOnly> push(push_handler);
+    for (auto c : src)
+        push.feed(&c, 1);
+    push.finish();
+    ensure_eq("push atoms", push_handler.atoms, expected);
+
+    sexp::BinaryWriter writer;
+    sexp::parse(src, writer);
+    AtomsOnly binary_handler;
+    sexp::parse_binary(writer.str(), binary_handler);
+    ensure_eq("binary atoms", binary_handler.atoms, expected);
+
+    AtomsOnly filtered;
+    sexp::Filter<AtomsOnly> filter(filtered);
+    typedef sexp::HandlerTraits<sexp::Filter<AtomsOnly> > filter_traits;
+    ensure("filter accepts tokens of the next handler",
+           filter_traits::has_atoms && !filter_traits::has_strings
+           && !filter_traits::has_comments);
+    sexp::parse(src, filter);
+    ensure_eq("filter atoms", filtered.atoms, expected);
+}
+
+template<> template<>
+void object::test<tid_skip>()
+{
+    // skips lists starting from skip-* atom and lists nested deeper
+    // than 2 levels
+    struct Selective
+    {
+        Selective() : depth(0), is_head(false), is_eof(false) {}
+
+        sexp::Action on_list_begin()
+        {
+            tokens.push_back("(");
+            is_head = true;
+            return (++depth > 2) ? sexp::skip_list : sexp::proceed;
+        }
+        void on_list_end()
+        {
+            tokens.push_back(")");
+            is_head = false;
+            --depth;
+        }
+        void on_comment(std::string &&s) { tokens.push_back(";" + s); }
+        void on_string(std::string &&s) { tokens.push_back("\"" + s); }
+        sexp::Action on_atom(std::string &&s)
+        {
+            tokens.push_back(s);
+            bool is_skip = is_head && s.substr(0, 5) == "skip-";
+            is_head = false;
+            return is_skip ? sexp::skip_list : sexp::proceed;
+        }
+        void on_eof() { is_eof = true; }
+
+        int depth;
+        bool is_head;
+        bool is_eof;
+        std::list<std::string> tokens;
+    };
+
+    std::string src("(keep a (skip-me \"x)\" ;(c\n b\\) c\"d e;f (n (m))"
+                    " \\( \"\\\\\\\"(\" ) z)\n"
+                    "(keep (x (deep (deeper 1) \")\") 3) y)\n"
+                    "(skip-top 1 2)(skip-at-end) ; comment\ntop-atom");
+    std::list<std::string> expected
+        = {"(", "keep", "a", "(", "skip-me", ")", "z", ")",
+           "(", "keep", "(", "x", "(", ")", "3", ")", "y", ")",
+           "(", "skip-top", ")", "(", "skip-at-end", ")",
+           "; comment", "top-atom"};
+
+    Selective buffer_handler;
+    sexp::parse(src, buffer_handler);
+    ensure_eq("buffer", buffer_handler.tokens, expected);
+    ensure("buffer eof", buffer_handler.is_eof);
+
+    Selective stream_handler;
+    std::istringstream in(src);
+    sexp::parse(in, stream_handler);
+    ensure_eq("stream", stream_handler.tokens, expected);
+
+    for (size_t chunk : {1, 2, 3, 5, 7, 11}) {
+        Selective push_handler;
+        sexp::PushParser<Selective> push(push_handler);
+        for (size_t pos = 0; pos < src.size(); pos += chunk)
+            push.feed(src.substr(pos, chunk));
+        push.finish();
+        ensure_eq(cor::concat("push by ", chunk), push_handler.tokens,
+                  expected);
+    }
+
+    Selective filtered;
+    sexp::Filter<Selective> filter(filtered);
+    sexp::parse(src, filter);
+    ensure_eq("filter", filtered.tokens, expected);
+
+    sexp::BinaryWriter writer;
+    sexp::parse(src, writer);
+    Selective binary_handler;
+    sexp::parse_binary(writer.str(), binary_handler);
+    ensure_eq("binary", binary_handler.tokens, expected);
+
+    try {
+        Selective handler;
+        sexp::parse(std::string("(skip-it \"a)"), handler);
+        fail("Expected failure parsing not limited string");
+    } catch (sexp::Error const &) {}
+}
+
+template<> template<>
+void object::test<tid_typed>()
+{
+    struct Number
+    {
+        std::string src;
+        sexp::AtomKind kind;
+        long i;
+        double r;
+    };
+    std::vector<Number> numbers = {
+        {"0", sexp::integer_atom, 0, 0}, {"-0", sexp::integer_atom, 0, 0},
+        {"+17", sexp::integer_atom, 17, 0}, {"007", sexp::integer_atom, 7, 0},
+        {"-9223372036854775808", sexp::integer_atom,
+         std::numeric_limits<long>::min(), 0},
+        {"9223372036854775807", sexp::integer_atom,
+         std::numeric_limits<long>::max(), 0},
+        {"9223372036854775808", sexp::real_atom, 0, 9223372036854775808.0},
+        {"123456789012345678901234567890", sexp::real_atom, 0,
+         123456789012345678901234567890.0},
+        {"1.5", sexp::real_atom, 0, 1.5}, {"-.5", sexp::real_atom, 0, -0.5},
+        {"5.", sexp::real_atom, 0, 5}, {"1e3", sexp::real_atom, 0, 1000},
+        {"1.2E-3", sexp::real_atom, 0, 1.2e-3},
+        {"0.000001", sexp::real_atom, 0, 1e-6},
+        {"3.14159265358979323846", sexp::real_atom, 0, 3.14159265358979323846},
+        {"1e-400", sexp::real_atom, 0, 0}, {"2.5e+300", sexp::real_atom, 0, 2.5e300},
+        {":key", sexp::keyword_atom, 0, 0}, {":", sexp::keyword_atom, 0, 0},
+        {"", sexp::symbol_atom, 0, 0}, {"-", sexp::symbol_atom, 0, 0},
+        {"+", sexp::symbol_atom, 0, 0}, {".", sexp::symbol_atom, 0, 0},
+        {"1e", sexp::symbol_atom, 0, 0}, {"e1", sexp::symbol_atom, 0, 0},
+        {"1-2", sexp::symbol_atom, 0, 0}, {"inf", sexp::symbol_atom, 0, 0},
+        {"nan", sexp::symbol_atom, 0, 0}, {"0x10", sexp::symbol_atom, 0, 0},
+        {"1,5", sexp::symbol_atom, 0, 0}, {"1.2.3", sexp::symbol_atom, 0, 0}
+    };
+    for (auto const &n : numbers) {
+        long i = 0;
+        double r = 0;
+        auto p = n.src.data();
+        auto kind = sexp::classify_atom(p, p + n.src.size(), i, r);
+        ensure_eq("kind of " + n.src, kind, n.kind);
+        if (kind == sexp::integer_atom)
+            ensure_eq("integer " + n.src, i, n.i);
+        else if (kind == sexp::real_atom)
+            ensure_eq("real " + n.src, r, n.r);
+    }
+
+    struct Typed : public RecordingHandler<sexp::StringRef>
+    {
+        void on_integer(long v) { tokens.push_back(cor::concat("i", v)); }
+        void on_real(double v) { tokens.push_back(cor::concat("r", v)); }
+        void on_keyword(sexp::StringRef &&s) { add("k", s); }
+    };
+    std::string src("(a 1 -2.5 :key \"3\" 4\\ 5 0x1) :x 6");
+    std::list<std::string> expected
+        = {"(", "a", "i1", "r-2.5", "kkey", "\"3", "4 5", "0x1", ")",
+           "kx", "i6"};
+    Typed buffer_handler;
+    sexp::parse(src, buffer_handler);
+    ensure_eq("buffer", buffer_handler.tokens, expected);
+
+    Typed stream_handler;
+    std::istringstream in(src);
+    sexp::parse(in, stream_handler);
+    ensure_eq("stream", stream_handler.tokens, expected);
+
+    sexp::BinaryWriter writer;
+    sexp::parse(src, writer);
+    writer.put_real(0.25);
+    Typed binary_handler;
+    sexp::parse_binary(writer.str(), binary_handler);
+    expected.push_back("r0.25");
+    ensure_eq("binary", binary_handler.tokens, expected);
+
+    // only integers are interesting, the rest are atoms
+    struct Integers : public RecordingHandler<std::string>
+    {
+        void on_integer(long v) { tokens.push_back(cor::concat("i", v)); }
+    };
+    Integers integers;
+    sexp::parse(src, integers);
+    expected = {"(", "a", "i1", "-2.5", ":key", "\"3", "4 5", "0x1", ")",
+                ":x", "i6"};
+    ensure_eq("integers", integers.tokens, expected);
+}
+
+/// strings are received by chunks, list is skipped after the 2nd string
+struct Chunks : public RecordingHandler<sexp::StringRef>
+{
+    static const size_t string_chunk_size = 4;
+
+    void on_string_chunk(sexp::StringRef &&s) { add("+", s); }
+    sexp::Action on_string_end()
+    {
+        tokens.push_back("\"");
+        return tokens.size() > 12 ? sexp::skip_list : sexp::proceed;
+    }
+};
+
+template<> template<>
+void object::test<tid_string_chunks>()
+{
+    std::string src("(a \"0123456789\" \"\" \"ab\\ncd\\x41\" b)"
+                    " (\"abcd\" \"efghi\" c)");
+    std::list<std::string> expected
+        = {"(", "a", "+0123", "+4567", "+89", "\"", "\"", "+ab\nc", "+dA",
+           "\"", "b", ")", "(", "+abcd", "\"", ")"};
+    Chunks buffer_handler;
+    sexp::parse(src, buffer_handler);
+    ensure_eq("buffer", buffer_handler.tokens, expected);
+
+    Chunks stream_handler;
+    std::istringstream in(src);
+    sexp::parse(in, stream_handler);
+    ensure_eq("stream", stream_handler.tokens, expected);
+
+    for (size_t size = 1; size < 6; ++size) {
+        Chunks push_handler;
+        sexp::PushParser<Chunks> push(push_handler);
+        for (size_t pos = 0; pos < src.size(); pos += size)
+            push.feed(src.substr(pos, size));
+        push.finish();
+        ensure_eq(cor::concat("pushed by ", size), push_handler.tokens,
+                  expected);
+    }
+
+    Chunks filtered;
+    sexp::Filter<Chunks> filter(filtered);
+    typedef sexp::HandlerTraits<sexp::Filter<Chunks> > filter_traits;
+    ensure("filter accepts chunks", filter_traits::has_string_chunks);
+    ensure_eq("filter chunk size",
+              size_t(filter_traits::string_chunk_size), 4);
+    sexp::parse(src, filter);
+    ensure_eq("filtered", filtered.tokens, expected);
+
+    // writer gets strings by chunks
+    std::string big(100 * 1024, 'x');
+    src = "(\"" + big + "\\\"\\\\" + big + "\")";
+    sexp::Writer writer;
+    sexp::parse(src, writer);
+    RecordingHandler<std::string> original, written;
+    sexp::parse(src, original);
+    sexp::parse(writer.str(), written);
+    ensure_eq("same tokens", written.tokens, original.tokens);
+
+    sexp::Writer filtered_writer;
+    sexp::Filter<sexp::Writer> writer_filter(filtered_writer);
+    sexp::parse(src, writer_filter);
+    ensure_eq("written through filter", filtered_writer.str(), writer.str());
+}
+
+template<> template<>
+void object::test<tid_lexer>()
+{
+    typedef sexp::Lexer::Kind Kind;
+    std::string src
+        ("(a \"b c\" d\\ e \"f\\x41\" ;g\n(h (i j) \"\")) k\\x4 ;l");
+    std::list<std::string> expected
+        = {"(", "a", "\"b c", "d e", "\"fA", ";g", "(", "h", "(", "i", "j",
+           ")", "\"", ")", ")", "k\x04", ";l"};
+    auto read = [](sexp::Lexer &lexer) {
+        std::list<std::string> res;
+        for (auto const &t : lexer) {
+            static char const *prefix[] = {"(", ")", "", "\"", ";"};
+            res.push_back(prefix[t.kind] + t.value.str());
+        }
+        return res;
+    };
+    sexp::Lexer buffer_lexer(src);
+    buffer_lexer.set_comments(true);
+    ensure_eq("buffer", read(buffer_lexer), expected);
+    ensure_eq("end is repeated", buffer_lexer.next().kind, Kind::End);
+    ensure_eq("end position", buffer_lexer.position(), src.size());
+
+    for (size_t size = 1; size < 8; ++size) {
+        std::istringstream in(src);
+        sexp::Lexer stream_lexer(in, size);
+        stream_lexer.set_comments(true);
+        ensure_eq(cor::concat("stream by ", size), read(stream_lexer),
+                  expected);
+    }
+
+    // comments are skipped by default, tokens refer to the input
+    sexp::Lexer lexer(src);
+    ensure_eq("list", lexer.next().kind, Kind::ListBegin);
+    auto const &t = lexer.next();
+    ensure_eq("atom", t.kind, Kind::Atom);
+    ensure_eq("atom pos", t.pos, 1);
+    ensure("refers to input", t.value.data() == src.data() + 1);
+    ensure_eq("skipped string", lexer.next().value, "b c");
+    lexer.next();
+    lexer.next();
+    ensure_eq("no comment", lexer.next().kind, Kind::ListBegin);
+    lexer.skip();
+    ensure_eq("level after skip", lexer.level(), 1);
+    ensure_eq("skipped list end", lexer.token().kind, Kind::ListEnd);
+    ensure_eq("skipped list end pos", lexer.token().pos,
+              src.find("\"\")") + 2);
+    ensure_eq("after skipped list", lexer.next().kind, Kind::ListEnd);
+    ensure_eq("top-level atom", lexer.next().value, "k\x04");
+    ensure_eq("end", lexer.next().kind, Kind::End);
+
+    // skipped list can be split between stream reads
+    for (size_t size = 1; size < 64; size *= 2) {
+        std::istringstream in(src);
+        sexp::Lexer stream_lexer(in, size);
+        auto name = cor::concat("skip by ", size);
+        ensure_eq(name, stream_lexer.next().kind, Kind::ListBegin);
+        stream_lexer.skip();
+        ensure_eq(name + " level", stream_lexer.level(), 0);
+        ensure_eq(name + " end pos", stream_lexer.token().pos,
+                  src.find("\"\")) ") + 3);
+        ensure_eq(name + " atom", stream_lexer.next().value, "k\x04");
+    }
+    ensure_throws<sexp::Error>("skip not limited string", []() {
+            std::string src("(a (\"b");
+            sexp::Lexer lexer(src);
+            lexer.next();
+            lexer.skip();
+        });
+
+    auto ensure_error = [](std::string const &name, std::string const &src,
+                           size_t pos) {
+        sexp::Lexer lexer(src);
+        try {
+            while (lexer.next().kind != Kind::End) {}
+            fail(name + ": expected error");
+        } catch (sexp::Error const &e) {
+            ensure_eq(name + " pos", e.pos, pos);
+        }
+    };
+    ensure_error("unexpected )", "(a))", 3);
+    ensure_error("not limited string", "(\"a", 3);
+    ensure_error("empty hex", "a\\xz", 3);
+}
+
+template<> template<>
+void object::test<tid_index>()
+{
+    TempFile data("(a 1) atom (b (2 3) \"x)\")\n; (c)\n(a 4) (\"s\") (");
+    auto append = [&data](std::string const &s) {
+        cor::FdHandle fd(::open(data.path.c_str(), O_WRONLY | O_APPEND));
+        ensure("append", ::write(fd.value(), s.data(), s.size())
+               == (ssize_t)s.size());
+    };
+    auto parsed = [](sexp::Index const &index, std::string const &key) {
+        RecordingHandler<std::string> handler;
+        if (!index.parse(key, handler))
+            return std::list<std::string>({"none"});
+        return handler.tokens;
+    };
+    typedef std::list<std::string> tokens_type;
+
+    auto remove_index = cor::on_scope_exit([&data]() {
+            ::unlink((data.path + ".idx").c_str());
+        });
+    {
+        sexp::Index index(data.path);
+        ensure_eq("nothing is loaded", index.size(), 0);
+        // incomplete form is not indexed
+        ensure_eq("forms", index.update(), 3);
+        ensure_eq("keys", index.size(), 2);
+        ensure_eq("last a", parsed(index, "a"), tokens_type
+                  ({"(", "a", "4", ")"}));
+        ensure_eq("b", parsed(index, "b"), tokens_type
+                  ({"(", "b", "(", "2", "3", ")", "\"x)", ")"}));
+        ensure_eq("commented", parsed(index, "c"), tokens_type({"none"}));
+        ensure_eq("b entry", index.find("b")->offset, 11);
+        ensure_eq("no updates", index.update(), 0);
+
+        append("d 5)\n(e)");
+        ensure_eq("appended", index.update(), 2);
+        ensure_eq("d", parsed(index, "d"), tokens_type
+                  ({"(", "d", "5", ")"}));
+    }
+    {
+        // loaded from the sidecar
+        sexp::Index index(data.path);
+        ensure_eq("loaded", index.size(), 4);
+        ensure_eq("no updates after loading", index.update(), 0);
+        ensure_eq("e", parsed(index, "e"), tokens_type({"(", "e", ")"}));
+        append("(f)");
+        ensure_eq("appended to loaded", index.update(), 1);
+
+        // form with incomplete string or escape is indexed later
+        append("\n(g 1)\n(b \"partial str");
+        ensure_eq("complete form is indexed", index.update(), 1);
+        append("ing\") (k \\");
+        ensure_eq("completed string", index.update(), 1);
+        ensure_eq("b is replaced", parsed(index, "b"), tokens_type
+                  ({"(", "b", "\"partial string", ")"}));
+        append("y)");
+        ensure_eq("completed escape", index.update(), 1);
+        ensure_eq("g", parsed(index, "g"), tokens_type({"(", "g", "1", ")"}));
+        append("(m\\ n 1)");
+        ensure_eq("escaped key", index.update(), 1);
+        ensure("unescaped key", index.find("m n") != nullptr);
+    }
+    {
+        sexp::Index index(data.path);
+        ensure_eq("loaded appended", index.size(), 8);
+
+        // data file is shrunk, it is reindexed
+        TempFile shrunk("(\"x\" g) (h)");
+        ::rename(shrunk.path.c_str(), data.path.c_str());
+        ensure_eq("reindexed", index.update(), 1);
+        ensure_eq("old key", parsed(index, "a"), tokens_type({"none"}));
+        ensure_eq("h", parsed(index, "h"), tokens_type({"(", "h", ")"}));
+    }
+    // broken sidecar is ignored
+    {
+        TempFile broken("(\"h\" 8 3) (indexed 11) (\"h\"");
+        ::rename(broken.path.c_str(), (data.path + ".idx").c_str());
+        sexp::Index index(data.path);
+        ensure_eq("valid part is loaded", index.size(), 1);
+        ensure_eq("h is loaded", index.find("h")->offset, 8);
+        ensure_eq("nothing to index", index.update(), 0);
+        ensure_eq("h is the same", index.find("h")->size, 3);
+        sexp::Index reloaded(data.path);
+        ensure_eq("sidecar is rewritten", reloaded.size(), 1);
+    }
+}
+
+template<> template<>
+void object::test<tid_query>()
+{
+    std::string src
+        ("(config (devices (device :name X (port 1)) ; (device :name Y)\n"
+         " (device :type y :name \"Y\") (other (device :name Z)))"
+         " (device :name W)) (device :name V) (config (devices))");
+    auto query = [&src](std::string const &path) {
+        sexp::Writer out;
+        sexp::Query<sexp::Writer> q(path, out);
+        sexp::parse(src, q);
+        return out.str();
+    };
+    ensure_eq("devices", query("config/devices/device"),
+              "(device :name X (port 1))\n(device :type y :name \"Y\")\n");
+    ensure_eq("any name", query("*/*/device"),
+              "(device :name X (port 1))\n(device :type y :name \"Y\")\n");
+    ensure_eq("any depth", query("**/device"),
+              "(device :name X (port 1))\n(device :type y :name \"Y\")\n"
+              "(device :name Z)\n(device :name W)\n(device :name V)\n");
+    ensure_eq("in config", query("config/**/device"),
+              "(device :name X (port 1))\n(device :type y :name \"Y\")\n"
+              "(device :name Z)\n(device :name W)\n");
+    ensure_eq("nested", query("config/*/*/port"), "(port 1)\n");
+    ensure_eq("string value", query("**/device[:name=Y]"),
+              "(device :type y :name \"Y\")\n");
+    ensure_eq("2 predicates", query("**/device[:type=y][:name=Y]"),
+              "(device :type y :name \"Y\")\n");
+    ensure_eq("not satisfied", query("**/device[:type=y][:name=X]"), "");
+    ensure_eq("no value", query("**/device[port=1]"), "");
+    {
+        sexp::Writer out;
+        sexp::Query<sexp::Writer> q("device[:name=X]", out);
+        sexp::parse(std::string("(device :name (x) X) (device :name X)"), q);
+        ensure_eq("nested list value", out.str(), "(device :name X)\n");
+    }
+    ensure_eq("empty lists", query("config/devices"),
+              "(devices (device :name X (port 1)) (device :type y :name \"Y\")"
+              " (other (device :name Z)))\n(devices)\n");
+
+    // skipped lists are not tokenized, so errors are not noticed there
+    sexp::Writer out;
+    sexp::Query<sexp::Writer> q("a/b", out);
+    sexp::parse(std::string("(c \\x) (a (c \\xz) (b 1))"), q);
+    ensure_eq("skipped", out.str(), "(b 1)\n");
+    ensure_eq("count", q.count(), 1);
+
+    // next handler skips the rest of the matched list
+    struct Heads : public RecordingHandler<sexp::StringRef>
+    {
+        sexp::Action on_atom(sexp::StringRef &&s)
+        {
+            add("", s);
+            return sexp::skip_list;
+        }
+    };
+    std::vector<std::pair<std::string, size_t> > counts
+        = {{"**/device", 5}, {"**/device[:name=X]", 1}};
+    for (auto const &v : counts) {
+        Heads heads;
+        sexp::Query<Heads> q(v.first, heads);
+        sexp::parse(src, q);
+        ensure_eq(v.first, heads.tokens.size(), v.second * 3);
+    }
+
+    // next handler skips the matched list w/o head
+    struct SkipLists : public RecordingHandler<sexp::StringRef>
+    {
+        sexp::Action on_list_begin()
+        {
+            tokens.push_back("(");
+            return sexp::skip_list;
+        }
+    };
+    SkipLists skipping;
+    sexp::Query<SkipLists> headless("**", skipping);
+    sexp::parse(std::string("((a) b) (c)"), headless);
+    ensure_eq("skipped headless", skipping.tokens, std::list<std::string>
+              ({"(", ")", "(", ")"}));
+
+    for (auto path : {"", "a//b", "a/", "a[b]", "a[b=c]/d", "a[b=c"})
+        ensure_throws<cor::Error>(path, [path]() { sexp::QueryPath p(path); });
+}
+
+namespace {
+
+COR_SEXP_LITERAL(ConfigLiteral,
+                 "(config (devices (device :name X (port 1)) ; comment\n"
+                 " (device :type y :name \"Y\\x41\\\"\" \\(esc\\ aped)))"
+                 " \"\" top");
+COR_SEXP_LITERAL(EmptyLiteral, " ; nothing\n");
+
+/// state and nesting of the text parsed at compile time
+constexpr sexp::literal::Summary literal_summary(char const *text, size_t len)
+{
+    return sexp::literal::summary(text, 0, len, sexp::literal::Top);
+}
+
+}
+
+template<> template<>
+void object::test<tid_literal>()
+{
+    using namespace sexp::literal;
+    static_assert(literal_summary("(a))", 4).min_depth < 0, "unexpected )");
+    static_assert(literal_summary("((a)", 4).depth == 1, "not closed");
+    static_assert(literal_summary("(\"a)", 4).state == InString,
+                  "not limited string");
+    static_assert(literal_summary("a\\xz", 4).problem == wrong_escape,
+                  "wrong hex");
+    static_assert(literal_summary("(a\\", 3).state == AtomEscape,
+                  "escape at the end");
+    static_assert(literal_summary("a;b\n(c)", 7).min_depth == 0,
+                  "semicolon inside atom");
+    static_assert(ConfigLiteral::size() == 25, "count of nodes");
+    static_assert(ConfigLiteral::depth() == 4, "nesting");
+    static_assert(EmptyLiteral::size() == 0, "empty");
+
+    sexp::Writer out;
+    ConfigLiteral::parse(out);
+    ensure_eq("comments are skipped", out.str(),
+              "(config (devices (device :name X (port 1))"
+              " (device :type y :name \"YA\\\"\" \\(esc\\ aped)))\n"
+              "\"\" top");
+
+    auto p = ConfigLiteral().begin();
+    ensure_eq("list", p->kind, ListBegin);
+    ensure_eq("atom", (++p)->value(), "config");
+    std::vector<std::string> strings;
+    for (auto const &node : ConfigLiteral())
+        if (node.kind == String)
+            strings.push_back(node.value().str());
+    ensure_eq("strings", strings, std::vector<std::string>{"Y\\x41\\\"", ""});
+    ensure_eq("end", ConfigLiteral().end()->kind, End);
+    ensure("empty", EmptyLiteral().begin() == EmptyLiteral().end());
+
+    sexp::Writer query_out;
+    sexp::Query<sexp::Writer> query("**/device[:type=y]", query_out);
+    ConfigLiteral::parse(query);
+    ensure_eq("skipped", query_out.str(),
+              "(device :type y :name \"YA\\\"\" \\(esc\\ aped)\n");
+}
+
+template<> template<>
+void object::test<tid_hash>()
+{
+    auto mk_tree = [](std::string const &src) {
+        std::unique_ptr<sexp::HashTree> res(new sexp::HashTree());
+        sexp::parse(src, *res);
+        return res;
+    };
+    std::string src("(config (a 1 (\"x\")) (b \"2\") (c 3)) top");
+    auto base = mk_tree(src);
+    ensure_eq("nodes", base->size(), 6);
+    ensure_eq("head", base->head(2), "a");
+    ensure_eq("no head", base->node(3).has_head, false);
+    auto doc = sexp::mk_document(src);
+    ensure_eq("document index",
+              sexp::Document::Value(doc, base->node(4).index).first().value(),
+              "b");
+
+    auto same = mk_tree("; comment\n(config (a 1  (\"x\"))\n (b \"2\") (c 3)) top");
+    ensure_eq("formatting", same->hash(), base->hash());
+    ensure("no changes", sexp::diff(*base, *same).empty());
+    ensure("string vs atom", mk_tree("(config (a 1 (\"x\")) (b 2) (c 3)) top")
+           ->hash() != base->hash());
+
+    typedef std::tuple<int, std::string, std::string> change_type;
+    auto changes = [&base, &mk_tree](std::string const &src) {
+        auto tree = mk_tree(src);
+        std::vector<change_type> res;
+        for (auto const &c : sexp::diff(*base, *tree)) {
+            res.push_back(change_type
+                          (c.kind,
+                           c.from == sexp::HashTree::npos
+                           ? "" : base->head(c.from).str(),
+                           c.to == sexp::HashTree::npos
+                           ? "" : tree->head(c.to).str()));
+        }
+        return res;
+    };
+    typedef std::vector<change_type> changes_type;
+    ensure_eq("nested", changes("(config (a 1 (\"y\")) (b \"2\") (c 3)) top"),
+              changes_type{change_type(sexp::Change::Changed, "", "")});
+    ensure_eq("value", changes("(config (a 1 (\"x\")) (b \"2\") (c 4)) top"),
+              changes_type{change_type(sexp::Change::Changed, "c", "c")});
+    ensure_eq("moved", changes("(config (c 3) (a 1 (\"x\")) (b \"2\")) top"),
+              changes_type{change_type(sexp::Change::Changed,
+                                       "config", "config")});
+    ensure_eq("added/removed",
+              changes("(config (a 1 (\"x\")) (c 4) (d 5)) top"),
+              changes_type{change_type(sexp::Change::Removed, "b", ""),
+                      change_type(sexp::Change::Changed, "c", "c"),
+                      change_type(sexp::Change::Added, "", "d")});
+    ensure_eq("top level", changes("(config (a 1 (\"x\")) (b \"2\") (c 3))"),
+              changes_type{change_type(sexp::Change::Changed, "", "")});
+
+    auto unclosed = mk_tree("(a (b x");
+    ensure_eq("unclosed nodes", unclosed->size(), 3);
+    ensure("unclosed hash", unclosed->hash() != 0);
+    auto other = mk_tree("(a (b y");
+    ensure("unclosed differ", other->hash() != unclosed->hash());
+    ensure_eq("unclosed diff", sexp::diff(*unclosed, *other).size(), 1);
+    ensure("closed at the end", mk_tree("(a (b x))")->hash() == unclosed->hash());
+}
+
 }
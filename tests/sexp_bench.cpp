@@ -0,0 +1,355 @@
+#include <cor/sexp_impl.hpp>
+#include <cor/sexp_parallel.hpp>
+#include <cor/sexp_document.hpp>
+#include <cor/sexp_writer.hpp>
+#include <cor/sexp_binary.hpp>
+#include <cor/sexp_lexer.hpp>
+#include <cor/sexp_index.hpp>
+#include <cor/sexp_query.hpp>
+#include <cor/sexp_hash.hpp>
+
+#include <chrono>
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <functional>
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+namespace {
+
+template <typename TokenT>
+class BasicCountingHandler
+{
+public:
+    BasicCountingHandler() : lists(0), tokens(0), bytes(0) {}
+
+    void on_list_begin() { ++lists; }
+    void on_list_end() {}
+    void on_comment(TokenT &&s) { count(s); }
+    void on_string(TokenT &&s) { count(s); }
+    void on_atom(TokenT &&s) { count(s); }
+    void on_eof() {}
+
+    size_t lists;
+    size_t tokens;
+    size_t bytes;
+
+private:
+    void count(TokenT const &s)
+    {
+        ++tokens;
+        bytes += s.size();
+    }
+};
+
+typedef BasicCountingHandler<std::string> CountingHandler;
+
+class RefCountingHandler : public BasicCountingHandler<cor::StringRef>
+{
+public:
+    typedef cor::StringRef token_type;
+};
+
+/// comments are skipped by the parser
+class NoCommentsHandler
+{
+public:
+    NoCommentsHandler() : tokens(0) {}
+
+    void on_list_begin() {}
+    void on_list_end() {}
+    void on_string(std::string &&) { ++tokens; }
+    void on_atom(std::string &&) { ++tokens; }
+    void on_eof() {}
+
+    size_t tokens;
+};
+
+/// only heads of top-level lists are read, the rest is skipped
+class HeadsHandler
+{
+public:
+    typedef cor::StringRef token_type;
+
+    HeadsHandler() : heads(0), is_head(false) {}
+
+    void on_list_begin() { is_head = true; }
+    void on_list_end() {}
+    cor::sexp::Action on_atom(cor::StringRef &&)
+    {
+        if (!is_head)
+            return cor::sexp::proceed;
+        is_head = false;
+        ++heads;
+        return cor::sexp::skip_list;
+    }
+    void on_eof() {}
+
+    size_t heads;
+    bool is_head;
+};
+
+/// numbers are converted by the parser
+class NumbersHandler
+{
+public:
+    NumbersHandler() : sum(0) {}
+
+    void on_list_begin() {}
+    void on_list_end() {}
+    void on_atom(cor::StringRef &&) {}
+    void on_integer(long v) { sum += v; }
+    void on_real(double v) { sum += v; }
+    void on_eof() {}
+
+    double sum;
+};
+
+/// numbers are converted from atoms as it is done w/o typed callbacks
+class AtomNumbersHandler
+{
+public:
+    typedef cor::StringRef token_type;
+
+    AtomNumbersHandler() : sum(0) {}
+
+    void on_list_begin() {}
+    void on_list_end() {}
+    void on_atom(cor::StringRef &&s)
+    {
+        std::string v(s.begin(), s.end());
+        char *end = nullptr;
+        auto i = strtol(v.c_str(), &end, 10);
+        if (end == v.c_str() + v.size()) {
+            sum += i;
+            return;
+        }
+        auto r = strtod(v.c_str(), &end);
+        if (end == v.c_str() + v.size())
+            sum += r;
+    }
+    void on_eof() {}
+
+    double sum;
+};
+
+std::string mk_document(size_t size)
+{
+    std::string res;
+    res.reserve(size + 256);
+    for (size_t i = 0; res.size() < size; ++i) {
+        res += "(record :id ";
+        res += std::to_string(i);
+        res += " :name \"name of the record\\n\\tescaped\" :value 3.1415\n";
+        res += "  ; comment describing the record in some details\n";
+        res += "  (items first-item second-item third-item \"\\x41\"))\n";
+    }
+    return res;
+}
+
+std::string mk_commented_document(size_t size)
+{
+    std::string res;
+    res.reserve(size + 256);
+    for (size_t i = 0; res.size() < size; ++i) {
+        res += ";; option " + std::to_string(i) + "\n";
+        res += ";; this option is described here in a lot of details, it\n";
+        res += ";; can be (set \"to\" any) value, default is 0\n";
+        res += "(option-" + std::to_string(i) + " 0)\n";
+    }
+    return res;
+}
+
+std::string mk_numbers_document(size_t size)
+{
+    std::string res;
+    res.reserve(size + 256);
+    for (size_t i = 0; res.size() < size; ++i) {
+        res += "(point " + std::to_string(i) + " " + std::to_string(i * 7)
+            + " 0.25 -12.5 1.5e3 " + std::to_string(i % 1000) + ".125)\n";
+    }
+    return res;
+}
+
+std::string mk_long_tokens_document(size_t size)
+{
+    std::string res;
+    res.reserve(size + 8192);
+    std::string text;
+    for (size_t i = 0; text.size() < 4000; ++i)
+        text += "generated configuration value " + std::to_string(i);
+    for (size_t i = 0; res.size() < size; ++i) {
+        res += "; " + text + "\n";
+        res += "(record \"" + text + "\" " + text.substr(0, 100) + ")\n";
+    }
+    return res;
+}
+
+template <typename FnT>
+void measure(std::string const &name, size_t size, FnT fn)
+{
+    static const int repeat = 10;
+    double best = 0;
+    for (int i = 0; i < repeat; ++i) {
+        auto begin = std::chrono::steady_clock::now();
+        fn();
+        std::chrono::duration<double> spent
+            = std::chrono::steady_clock::now() - begin;
+        double mbps = (size / (1024.0 * 1024.0)) / spent.count();
+        if (mbps > best)
+            best = mbps;
+    }
+    std::cout << name << ": " << best << " MB/s" << std::endl;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    size_t size = (argc > 1 ? std::stoul(argv[1]) : 16) * 1024 * 1024;
+    auto run = [](std::string const &name, std::string const &doc) {
+        measure(name + ", istream", doc.size(), [&doc]() {
+                CountingHandler handler;
+                std::istringstream in(doc);
+                cor::sexp::parse(in, handler);
+            });
+        measure(name + ", buffer", doc.size(), [&doc]() {
+                CountingHandler handler;
+                cor::sexp::parse(doc.data(), doc.size(), handler);
+            });
+        measure(name + ", buffer, refs", doc.size(), [&doc]() {
+                RefCountingHandler handler;
+                cor::sexp::parse(doc.data(), doc.size(), handler);
+            });
+    };
+    auto doc = mk_document(size);
+    run("records", doc);
+
+    measure("records, skip", doc.size(), [&doc]() {
+            HeadsHandler handler;
+            cor::sexp::parse(doc, handler);
+        });
+
+    measure("records, query", doc.size(), [&doc]() {
+            RefCountingHandler handler;
+            cor::sexp::Query<RefCountingHandler> query("record/items", handler);
+            cor::sexp::parse(doc, query);
+        });
+    measure("records, query predicate", doc.size(), [&doc]() {
+            RefCountingHandler handler;
+            cor::sexp::Query<RefCountingHandler> query
+                ("record[:id=1000]", handler);
+            cor::sexp::parse(doc, query);
+        });
+
+    measure("records, lexer", doc.size(), [&doc]() {
+            cor::sexp::Lexer lexer(doc);
+            size_t bytes = 0;
+            for (auto const &t : lexer)
+                bytes += t.value.size();
+        });
+    measure("records, lexer, istream", doc.size(), [&doc]() {
+            std::istringstream in(doc);
+            cor::sexp::Lexer lexer(in);
+            size_t bytes = 0;
+            for (auto const &t : lexer)
+                bytes += t.value.size();
+        });
+
+    measure("records, parallel", doc.size(), [&doc]() {
+            cor::sexp::parse_parallel(doc.data(), doc.size(), []() {
+                    return cor::make_unique<RefCountingHandler>();
+                });
+        });
+
+    measure("records, document", doc.size(), [&doc]() {
+            auto document = cor::sexp::mk_document(doc);
+        });
+
+    measure("records, hash tree", doc.size(), [&doc]() {
+            cor::sexp::HashTree tree;
+            cor::sexp::parse(doc, tree);
+        });
+
+    measure("records, transform", doc.size(), [&doc]() {
+            cor::sexp::Writer writer;
+            cor::sexp::parse(doc, writer);
+        });
+
+    // throughput is measured relative to the text size to compare
+    // with the text parsing
+    cor::sexp::BinaryWriter encoder;
+    cor::sexp::parse(doc, encoder);
+    auto binary = encoder.str();
+    measure("records, binary encode", doc.size(), [&doc]() {
+            cor::sexp::BinaryWriter writer;
+            cor::sexp::parse(doc, writer);
+        });
+    measure("records, binary", doc.size(), [&binary]() {
+            CountingHandler handler;
+            cor::sexp::parse_binary(binary, handler);
+        });
+    measure("records, binary, refs", doc.size(), [&binary]() {
+            RefCountingHandler handler;
+            cor::sexp::parse_binary(binary, handler);
+        });
+
+    std::string path("/tmp/cor_sexp_bench_XXXXXX");
+    cor::FdHandle fd(::mkstemp(&path[0]));
+    if (::write(fd.value(), doc.data(), doc.size()) == (ssize_t)doc.size()) {
+        measure("records, file", doc.size(), [&path]() {
+                RefCountingHandler handler;
+                cor::sexp::parse_file(path, handler);
+            });
+    }
+    measure("records, index", doc.size(), [&path]() {
+            ::unlink((path + ".idx").c_str());
+            cor::sexp::Index index(path);
+            index.update();
+        });
+    ::unlink((path + ".idx").c_str());
+    ::unlink(path.c_str());
+
+    auto commented = mk_commented_document(size);
+    measure("commented, buffer", commented.size(), [&commented]() {
+            CountingHandler handler;
+            cor::sexp::parse(commented, handler);
+        });
+    measure("commented, no comments", commented.size(), [&commented]() {
+            NoCommentsHandler handler;
+            cor::sexp::parse(commented, handler);
+        });
+
+    auto numbers = mk_numbers_document(size);
+    measure("numbers, atoms", numbers.size(), [&numbers]() {
+            AtomNumbersHandler handler;
+            cor::sexp::parse(numbers, handler);
+        });
+    measure("numbers, count", numbers.size(), [&numbers]() {
+            RefCountingHandler handler;
+            cor::sexp::parse(numbers, handler);
+        });
+    measure("numbers, typed", numbers.size(), [&numbers]() {
+            NumbersHandler handler;
+            cor::sexp::parse(numbers, handler);
+        });
+
+    // huge string is pushed by pieces to the writer, parser keeps only
+    // a chunk of it
+    auto huge = "(blob \"" + std::string(size, 'x') + "\")";
+    measure("huge string, push to writer", huge.size(), [&huge]() {
+            cor::FdHandle out(::open("/dev/null", O_WRONLY));
+            cor::sexp::Writer writer(out.value());
+            cor::sexp::PushParser<cor::sexp::Writer> parser(writer);
+            for (size_t pos = 0; pos < huge.size(); pos += 64 * 1024)
+                parser.feed(huge.data() + pos,
+                            std::min<size_t>(64 * 1024, huge.size() - pos));
+            parser.finish();
+        });
+
+    run("long tokens", mk_long_tokens_document(size));
+    return 0;
+}
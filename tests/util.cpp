@@ -1,5 +1,7 @@
 #include <cor/util.hpp>
 #include <cor/pipe.hpp>
+#include <cor/flat_map.hpp>
+#include <cor/pool.hpp>
 #include <tut/tut.hpp>
 
 #include "tests_common.hpp"
@@ -13,6 +15,9 @@
 #include <list>
 #include <array>
 #include <sstream>
+#include <thread>
+#include <algorithm>
+#include <string.h>
 
 using std::string;
 using std::runtime_error;
@@ -40,7 +45,9 @@ enum test_ids {
     tid_tagged_storage,
     tid_string_join,
     tid_string_split,
-    tid_tuple
+    tid_tuple,
+    tid_flat_map,
+    tid_pool
 };
 
 class TestTraits
@@ -396,4 +403,67 @@ void object::test<tid_tuple>()
     
 }
 
+template<> template<>
+void object::test<tid_flat_map>()
+{
+    cor::FlatMap<std::string, int, cor::StringRefHash, cor::StringRefEqual>
+        names;
+    ensure("empty", names.find(cor::StringRef("a")) == nullptr);
+    ensure_eq("not inserted", names.size(), 0);
+    for (int i = 0; i < 1000; ++i)
+        ensure("inserted", names.insert(std::to_string(i), i).second);
+    auto res = names.insert("7", 0);
+    ensure("not overwritten", !res.second);
+    ensure_eq("existing", *res.first, 7);
+    for (int i = 0; i < 1000; ++i) {
+        auto s = std::to_string(i);
+        auto p = names.find(cor::StringRef(s.data(), s.size()));
+        ensure("found", p != nullptr);
+        ensure_eq("value", *p, i);
+    }
+    ensure("missing", names.find(cor::StringRef("1000")) == nullptr);
+    ensure_eq("size", names.size(), 1000);
+    ensure_eq("insertion order", names.begin()->first, "0");
+
+    cor::FlatMap<uint32_t, int, cor::IntegerHash> ids;
+    ids.reserve(10);
+    for (uint32_t i = 0; i < 100; ++i)
+        ids.insert(i * 1024, i);
+    for (uint32_t i = 0; i < 100; ++i)
+        ensure_eq("id", *ids.find(i * 1024), int(i));
+    ensure("missing id", ids.find(1u) == nullptr);
+}
+
+template<> template<>
+void object::test<tid_pool>()
+{
+    std::vector<void*> blocks;
+    for (size_t i = 0; i < 1000; ++i) {
+        auto p = cor::pool_allocate(24);
+        memset(p, 0xff, 24);
+        blocks.push_back(p);
+    }
+    std::sort(blocks.begin(), blocks.end());
+    ensure("unique blocks",
+           std::unique(blocks.begin(), blocks.end()) == blocks.end());
+    // blocks are released by other thread
+    std::thread([&blocks]() {
+            for (auto p : blocks)
+                cor::pool_deallocate(p, 24);
+        }).join();
+    auto chunks = cor::pool_chunks();
+    for (size_t i = 0; i < 1000; ++i)
+        blocks[i] = cor::pool_allocate(24);
+    ensure_eq("blocks of the finished thread are reused",
+              cor::pool_chunks(), chunks);
+    for (auto p : blocks)
+        cor::pool_deallocate(p, 24);
+
+    auto big = cor::pool_allocate(cor::pool_max_size + 1);
+    cor::pool_deallocate(big, cor::pool_max_size + 1);
+
+    std::list<int, cor::PoolAllocator<int> > items{1, 2, 3};
+    ensure_eq("list", items.back(), 3);
+}
+
 }
@@ -0,0 +1,185 @@
+#include <cor/sexp_zlib.hpp>
+#include <cor/util.hpp>
+#include <cor/pipe.hpp>
+#include <tut/tut.hpp>
+
+#include "tests_common.hpp"
+
+#include <zlib.h>
+
+#include <string>
+#include <list>
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+namespace tut
+{
+
+struct zlib_test
+{
+    virtual ~zlib_test()
+    {
+    }
+};
+
+typedef test_group<zlib_test> tf;
+typedef tf::object object;
+tf cor_zlib_test("compressed s-expressions");
+
+enum test_ids {
+    tid_plain = 1,
+    tid_gzip,
+    tid_errors
+};
+
+namespace sexp = cor::sexp;
+
+namespace {
+
+std::string gzip(std::string const &src)
+{
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                 Z_DEFAULT_STRATEGY);
+    std::string res(deflateBound(&zs, src.size()), 0);
+    zs.next_in = (Bytef*)src.data();
+    zs.avail_in = src.size();
+    zs.next_out = (Bytef*)&res[0];
+    zs.avail_out = res.size();
+    deflate(&zs, Z_FINISH);
+    res.resize(res.size() - zs.avail_out);
+    deflateEnd(&zs);
+    return res;
+}
+
+class TempFile
+{
+public:
+    TempFile(std::string const &data)
+        : path("/tmp/cor_test_XXXXXX")
+    {
+        cor::FdHandle fd(::mkstemp(&path[0]));
+        if (!fd.is_valid())
+            throw cor::CError(errno, "Can't create temp file");
+        auto len = ::write(fd.value(), data.data(), data.size());
+        if (len != (ssize_t)data.size())
+            throw cor::CError(errno, "Can't write temp file");
+    }
+
+    ~TempFile() { ::unlink(path.c_str()); }
+
+    std::string path;
+};
+
+struct Counter
+{
+    typedef cor::StringRef token_type;
+
+    Counter() : lists(0), atoms(0), bytes(0) {}
+
+    void on_list_begin() { ++lists; }
+    void on_list_end() {}
+    void on_atom(cor::StringRef &&s) { ++atoms; bytes += s.size(); }
+    void on_eof() {}
+
+    size_t lists;
+    size_t atoms;
+    size_t bytes;
+};
+
+std::string mk_data(size_t count)
+{
+    std::string res;
+    for (size_t i = 0; i < count; ++i)
+        res += "(item " + std::to_string(i) + ")\n";
+    return res;
+}
+
+/// data is read by small blocks to check tokens split between blocks
+Counter parse(std::string const &path)
+{
+    Counter res;
+    sexp::CompressedSource src(path, 7, 2);
+    sexp::parse_compressed(src, res);
+    return res;
+}
+
+}
+
+template<> template<>
+void object::test<tid_plain>()
+{
+    auto data = mk_data(1000);
+    TempFile file(data);
+    auto counter = parse(file.path);
+    ensure_eq("lists", counter.lists, 1000);
+    ensure_eq("atoms", counter.atoms, 2000);
+
+    TempFile empty("");
+    ensure_eq("empty", parse(empty.path).lists, 0);
+}
+
+template<> template<>
+void object::test<tid_gzip>()
+{
+    auto data = mk_data(10000);
+    TempFile file(gzip(data));
+    auto counter = parse(file.path);
+    ensure_eq("lists", counter.lists, 10000);
+    ensure_eq("atoms", counter.atoms, 20000);
+
+    // concatenated members
+    TempFile joined(gzip(data) + gzip(data));
+    Counter all;
+    sexp::parse_compressed(joined.path, all);
+    ensure_eq("all lists", all.lists, 20000);
+    ensure_eq("all bytes", all.bytes, counter.bytes * 2);
+
+    cor::FdHandle fd(::open(file.path.c_str(), O_RDONLY));
+    Counter from_fd;
+    sexp::parse_compressed(fd.value(), from_fd);
+    ensure_eq("from fd", from_fd.lists, 10000);
+}
+
+template<> template<>
+void object::test<tid_errors>()
+{
+    auto compressed = gzip(mk_data(10000));
+    TempFile truncated(compressed.substr(0, compressed.size() / 2));
+    ensure_throws<cor::Error>("truncated", [&truncated]() {
+            parse(truncated.path);
+        });
+
+    TempFile zstd(std::string("\x28\xb5\x2f\xfd") + "data");
+    ensure_throws<cor::Error>("zstd", [&zstd]() { parse(zstd.path); });
+
+    // parsing is stopped while data is still decompressed
+    TempFile wrong(gzip(")" + mk_data(10000)));
+    try {
+        parse(wrong.path);
+        fail("expected parse error");
+    } catch (sexp::Error const &e) {
+        ensure_eq("error position", e.pos, 1);
+    }
+    ensure_throws<cor::Error>("no file", []() {
+            parse("/nonexistent/file");
+        });
+    // the writer keeps the pipe open, the waiting worker is stopped
+    cor::Pipe pipe;
+    std::string unbalanced("(a))");
+    ensure_eq("written", ::write(pipe.second(), unbalanced.data(),
+                                 unbalanced.size()), 4);
+    try {
+        sexp::CompressedSource src(pipe.first(), unbalanced.size());
+        Counter counter;
+        sexp::parse_compressed(src, counter);
+        fail("expected parse error");
+    } catch (sexp::Error const &e) {
+        ensure_eq("pipe error position", e.pos, 4);
+    }
+}
+
+}